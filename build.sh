@@ -9,3 +9,5 @@ cd ..
 
 
 cp build/demo ./
+cp build/dict_compiler ./
+cp build/dict_stats ./
@@ -2,8 +2,10 @@
 #include <exception>
 #include <map>
 #include <chrono>
+#include <iostream>
 
 #include "src/make_unique.h"
+#include "src/logger.h"
 #include "src/text_analyzer.h"
 #include "src/nlp_stringutil.h"
 
@@ -11,7 +13,13 @@ using namespace std;
 
 const char* const STOP_DICT_PATH = "data/symbols.unicode.txt";
 
+static void logToStderr(const string& message) {
+    cerr << message << endl;
+}
+
 int main(int argc, char** argv) {
+    // 库内默认不输出, 词典加载失败等消息打到stderr
+    text_analysis::setLogHandler(logToStderr);
     map<string, string> dicts;
     // dicts["id"] = "data/dict/id.dict.utf8";
     dicts["cn"] = "data/dict/cn.dict.utf8";
@@ -27,30 +35,46 @@ int main(int argc, char** argv) {
     analyzer = make_unique<text_analysis::TextAnalyzer>();
 
     // std::cout << "start init trie ..." << std::endl;
-    for (auto&& dic : dicts) {
-        // std::cout << "adding dict: " << dic.first << std::endl;
-        analyzer->addDict(dic.first, dic.second);
+    // 各地区词典与停用词词典并行加载
+    // 加载失败的词典已输出到stderr, 其余词典与停用词照常使用
+    if (!analyzer->addDicts(dicts, STOP_DICT_PATH)) {
+        std::cerr << "some dicts failed to load" << std::endl;
     }
 
-    // stop words
-    analyzer->addStopWordsDict(STOP_DICT_PATH);
-
     analyzer->init();
     // std::cout << "init success" << std::endl;
 
-    vector<string> words;
     string s;
     string country = "cn";
     if (argc > 1) {
         country = argv[1];
     }
+    // demo country stream: 不按行读取, 流式输出动态规划分词的结果
+    if (argc > 2 && string(argv[2]) == "stream") {
+        unique_ptr<text_analysis::StreamSegmenter> stream = analyzer->newStream(country,
+                text_analysis::STREAM_MP);
+        vector<text_analysis::StreamToken> tokens;
+        bool more = true;
+        while (more) {
+            more = stream->feed(std::cin, tokens) > 0;
+            if (!more) {
+                stream->finish(tokens);
+            }
+            for (size_t i = 0; i < tokens.size(); i++) {
+                cout << tokens[i].offset << "\t" << tokens[i].word << std::endl;
+            }
+        }
+        return 0;
+    }
+    // 归一化与两种分词一次完成, 共用解码、归一化与词图
+    text_analysis::CountryHandle handle = analyzer->resolveCountry(country);
+    text_analysis::SegmentContext ctx;
+    text_analysis::AnalyzeResult result;
     while (getline(std::cin, s)) {
-        analyzer->normalize(s, words);
-        cout <<  "normlize: " << text_analysis::StringUtil::join(words, " ") << std::endl;
-        analyzer->cut(s, country,  words);
-        cout <<  "mmseg: " << text_analysis::StringUtil::join(words, " ") << std::endl;
-        analyzer->cutMP(s, country, words);
-        cout << "mpseg: " << text_analysis::StringUtil::join(words, " ") << std::endl;
+        analyzer->analyze(s, handle, text_analysis::ANALYZE_ALL, ctx, result);
+        cout <<  "normlize: " << text_analysis::StringUtil::join(result.normalized, " ") << std::endl;
+        cout <<  "mmseg: " << text_analysis::StringUtil::join(result.mm, " ") << std::endl;
+        cout << "mpseg: " << text_analysis::StringUtil::join(result.mp, " ") << std::endl;
     }
     return 0;
 }
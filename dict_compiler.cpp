@@ -0,0 +1,59 @@
+#include <string.h>
+#include <iostream>
+#include <memory>
+
+#include "src/make_unique.h"
+#include "src/dict_trie.h"
+#include "src/logger.h"
+
+using namespace std;
+
+// 离线编译词典: dict_compiler [--dawg] [--fixed16|--fixed32] data/dict/id.dict.utf8 id.dict.bin
+// 线上通过 TextAnalyzer::addDictImage 加载
+static void logToStderr(const string& message) {
+    cerr << message << endl;
+}
+
+int main(int argc, char** argv) {
+    text_analysis::setLogHandler(logToStderr);
+    const char* prog = argv[0];
+    text_analysis::DictLayout layout = text_analysis::DICT_LAYOUT_TRIE;
+    text_analysis::DictWeightType weight_type = text_analysis::DICT_WEIGHT_DOUBLE;
+    for (; argc > 1 && strncmp(argv[1], "--", 2) == 0; argv++, argc--) {
+        if (strcmp(argv[1], "--dawg") == 0) {
+            layout = text_analysis::DICT_LAYOUT_DAWG;
+        } else if (strcmp(argv[1], "--fixed16") == 0) {
+            weight_type = text_analysis::DICT_WEIGHT_FIXED16;
+        } else if (strcmp(argv[1], "--fixed32") == 0) {
+            weight_type = text_analysis::DICT_WEIGHT_FIXED32;
+        } else {
+            argc = 0;
+            break;
+        }
+    }
+    if (argc < 3) {
+        cerr << "usage: " << prog << " [--dawg] [--fixed16|--fixed32] <dict_path> <image_path>"
+            << endl;
+        return 1;
+    }
+    unique_ptr<text_analysis::DictTrie> dict_trie = make_unique<text_analysis::DictTrie>();
+    if (!dict_trie->init(argv[1], layout)) {
+        cerr << "load dict failed: " << argv[1] << endl;
+        return 1;
+    }
+    if (!dict_trie->quantizeWeights(weight_type)) {
+        cerr << "quantize weights failed: " << argv[1] << endl;
+        return 1;
+    }
+    if (!dict_trie->saveImage(argv[2])) {
+        cerr << "write image failed: " << argv[2] << endl;
+        return 1;
+    }
+    // 校验写出的镜像可以正常加载, 包括每个section的校验和
+    unique_ptr<text_analysis::DictTrie> image_trie = make_unique<text_analysis::DictTrie>();
+    if (!image_trie->initImage(argv[2], true)) {
+        cerr << "verify image failed: " << argv[2] << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <dirent.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/make_unique.h"
+#include "src/dict_trie.h"
+#include "src/logger.h"
+
+using namespace std;
+
+// 词典统计: dict_stats [--dawg] [dict_dir], 默认统计 data/dict 下的全部文本词典
+// 用于评估容器内存以及比较trie/DAWG布局
+namespace {
+
+const char* const DEFAULT_DICT_DIR = "data/dict";
+const char* const DICT_SUFFIX = ".dict.utf8";
+
+bool listDicts(const string& dir, vector<string>& names) {
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) {
+        return false;
+    }
+    const size_t suffix_len = strlen(DICT_SUFFIX);
+    for (struct dirent* entry = readdir(d); entry != NULL; entry = readdir(d)) {
+        string name = entry->d_name;
+        if (name.size() > suffix_len
+                && name.compare(name.size() - suffix_len, suffix_len, DICT_SUFFIX) == 0) {
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+    sort(names.begin(), names.end());
+    return true;
+}
+
+void printStats(const string& name, const text_analysis::DictStats& stats) {
+    cout << name << endl;
+    cout << "  layout          " << (stats.layout == text_analysis::DICT_LAYOUT_DAWG ? "dawg" : "trie")
+        << endl;
+    cout << "  words           " << stats.word_count << endl;
+    cout << "  max word length " << stats.max_word_length << endl;
+    cout << "  nodes           " << stats.nodes.node_count << endl;
+    cout << "  unit bytes      " << stats.unit_bytes << endl;
+    cout << "  key bytes       " << stats.key_bytes << endl;
+    cout << "  node bytes      " << stats.nodes.bytes << endl;
+    cout << "  hash bytes      " << stats.hash_bytes << endl;
+    cout << "  weight bytes    " << stats.weight_bytes << endl;
+    cout << "  total bytes     " << stats.total_bytes << endl;
+    cout << "  weight range    [" << stats.min_weight << ", " << stats.max_weight << "]" << endl;
+    cout << "  branching      ";
+    const vector<size_t>& branching = stats.nodes.branching;
+    for (size_t k = 0; k < branching.size(); k++) {
+        if (branching[k] == 0) {
+            continue;
+        }
+        cout << " " << k << (k + 1 == branching.size() ? "+" : "") << ":" << branching[k];
+    }
+    cout << endl;
+}
+
+}
+
+static void logToStderr(const string& message) {
+    cerr << message << endl;
+}
+
+int main(int argc, char** argv) {
+    text_analysis::setLogHandler(logToStderr);
+    text_analysis::DictLayout layout = text_analysis::DICT_LAYOUT_TRIE;
+    if (argc > 1 && strcmp(argv[1], "--dawg") == 0) {
+        layout = text_analysis::DICT_LAYOUT_DAWG;
+        argv++;
+        argc--;
+    }
+    string dir = argc > 1 ? argv[1] : DEFAULT_DICT_DIR;
+    vector<string> names;
+    if (!listDicts(dir, names)) {
+        cerr << "usage: " << argv[0] << " [--dawg] [dict_dir]" << endl;
+        return 1;
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        unique_ptr<text_analysis::DictTrie> dict_trie = make_unique<text_analysis::DictTrie>();
+        if (!dict_trie->init(dir + "/" + names[i], layout)) {
+            cerr << "load dict failed: " << names[i] << endl;
+            continue;
+        }
+        text_analysis::DictStats stats;
+        dict_trie->getStats(stats);
+        printStats(names[i], stats);
+    }
+    return 0;
+}
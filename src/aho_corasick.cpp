@@ -0,0 +1,215 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  aho_corasick.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/16 14:42:15
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <algorithm>
+
+#include "aho_corasick.h"
+
+namespace text_analysis {
+
+AhoCorasick::AhoCorasick(const DictTrie& dict_trie, size_t max_word_len) {
+    build_nodes_.resize(1);
+    const PodArray<DictUnit>& units = dict_trie.getUnits();
+    std::vector<Rune> word;
+    for (size_t i = 0; i < units.size(); i++) {
+        if (units[i].length == 0 || units[i].length > max_word_len) {
+            continue;
+        }
+        dict_trie.getWordRunes(units[i], word);
+        insert(word.data(), word.size());
+    }
+    buildLinks();
+}
+
+void AhoCorasick::insert(const Rune* word, size_t length) {
+    int32_t node = 0;
+    for (size_t i = 0; i < length; i++) {
+        std::vector<std::pair<Rune, int32_t> >& children = build_nodes_[node].children;
+        auto iter = std::lower_bound(children.begin(), children.end(),
+                std::pair<Rune, int32_t>(word[i], -1));
+        if (iter != children.end() && iter->first == word[i]) {
+            node = iter->second;
+            continue;
+        }
+        int32_t child = build_nodes_.size();
+        children.insert(iter, std::pair<Rune, int32_t>(word[i], child));
+        build_nodes_.push_back(BuildNode());
+        build_nodes_.back().length = i + 1;
+        node = child;
+    }
+    build_nodes_[node].terminal = true;
+    max_length_ = std::max(max_length_, length);
+}
+
+// 节点按BFS重新编号, fail链指向深度更小的节点, 按编号顺序计算即可
+void AhoCorasick::buildLinks() {
+    const size_t size = build_nodes_.size();
+    std::vector<int32_t> bfs;
+    std::vector<int32_t> new_ids(size, 0);
+    bfs.reserve(size);
+    bfs.push_back(0);
+    for (size_t k = 0; k < bfs.size(); k++) {
+        for (const auto& item : build_nodes_[bfs[k]].children) {
+            new_ids[item.second] = bfs.size();
+            bfs.push_back(item.second);
+        }
+    }
+
+    child_begin_.resize(size + 1);
+    child_runes_.reserve(size - 1);
+    child_nodes_.reserve(size - 1);
+    depth_.resize(size);
+    for (size_t k = 0; k < size; k++) {
+        const BuildNode& node = build_nodes_[bfs[k]];
+        child_begin_[k] = child_runes_.size();
+        for (const auto& item : node.children) {
+            child_runes_.push_back(item.first);
+            child_nodes_.push_back(new_ids[item.second]);
+        }
+        depth_[k] = node.length;
+    }
+    child_begin_[size] = child_runes_.size();
+    root_ascii_.assign(ASCII_SIZE, -1);
+    for (uint32_t k = child_begin_[0]; k < child_begin_[1] && child_runes_[k] < ASCII_SIZE; k++) {
+        root_ascii_[child_runes_[k]] = child_nodes_[k];
+        start_scanner_.add(child_runes_[k]);
+    }
+
+    fail_.assign(size, 0);
+    output_.assign(size, -1);
+    output_next_.assign(size, -1);
+    for (size_t k = 0; k < size; k++) {
+        for (uint32_t c = child_begin_[k]; c < child_begin_[k + 1]; c++) {
+            int32_t node = child_nodes_[c];
+            int32_t fail = (k == 0) ? 0 : next(fail_[k], child_runes_[c]);
+            fail_[node] = fail;
+            output_next_[node] = output_[fail];
+            output_[node] = build_nodes_[bfs[node]].terminal ? node : output_[fail];
+        }
+    }
+    std::vector<BuildNode>().swap(build_nodes_);
+}
+
+int32_t AhoCorasick::child(int32_t node, Rune rune) const {
+    if (node == 0 && rune < ASCII_SIZE) {
+        return root_ascii_[rune];
+    }
+    const Rune* first = child_runes_.data() + child_begin_[node];
+    const Rune* last = child_runes_.data() + child_begin_[node + 1];
+    const Rune* iter = std::lower_bound(first, last, rune);
+    if (iter == last || *iter != rune) {
+        return -1;
+    }
+    return child_nodes_[iter - child_runes_.data()];
+}
+
+// 扫描到位置p时, 自动机状态的深度d保证起点小于 p-d+1 的词都已经出现,
+// 这些起点可以按贪心规则确定; 未确定的起点不超过max_length_个, 用环形数组记录最长的词
+void AhoCorasick::removeMatches(const std::string& text,
+        RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        std::vector<WordRange>& ranges,
+        std::vector<uint32_t>& window) const {
+    Scan scan;
+    scan.window.swap(window);
+    removeMatches(text, begin, end, true, scan, ranges);
+    window.swap(scan.window);
+}
+
+void AhoCorasick::removeMatches(const std::string& text,
+        RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        bool final,
+        Scan& scan,
+        std::vector<WordRange>& ranges) const {
+    const size_t size = end - begin;
+    if (empty()) {
+        // 没有停用词时只有一个片段
+        scan.p = size;
+        if (final && scan.j < size) {
+            ranges.push_back(WordRange(begin + scan.j, end - 1));
+            scan.i = scan.j = size;
+        }
+        return;
+    }
+    size_t window_size = 1;
+    while (window_size <= max_length_) {
+        window_size <<= 1;
+    }
+    const size_t mask = window_size - 1;
+    // final之后窗口总是全0, 复用时只需要保证大小
+    if (scan.window.size() != window_size) {
+        scan.window.assign(window_size, 0);
+    }
+    uint32_t* longest = scan.window.data();
+
+    size_t i = scan.i;
+    size_t j = scan.j;
+    auto settle = [&](size_t limit) {
+        while (i < limit) {
+            uint32_t length = longest[i & mask];
+            longest[i & mask] = 0;
+            if (length == 0) {
+                i++;
+                continue;
+            }
+            if (i > j) {
+                ranges.push_back(WordRange(begin + j, begin + i - 1));
+            }
+            for (size_t k = 1; k < length; k++) {
+                longest[(i + k) & mask] = 0;
+            }
+            i += length;
+            j = i;
+        }
+    };
+
+    int32_t state = scan.state;
+    size_t p = scan.p;
+    while (p < size) {
+        if (state == 0) {
+            // 在root时, 跳过的ascii字符不改变状态, 也没有词结束
+            // ascii区间内字节数等于rune数, 扫描长度不超过剩余的rune数
+            size_t offset = (begin + p)->offset;
+            size_t skip = start_scanner_.find(text.data() + offset,
+                    std::min(size - p, text.size() - offset));
+            if (skip > 0) {
+                p += skip;
+                settle(p);
+                continue;
+            }
+        }
+        state = next(state, (begin + p)->rune);
+        for (int32_t out = output_[state]; out >= 0; out = output_next_[out]) {
+            size_t start = p + 1 - depth_[out];
+            if (start >= i && longest[start & mask] < depth_[out]) {
+                longest[start & mask] = depth_[out];
+            }
+        }
+        settle(p + 1 - depth_[state]);
+        p++;
+    }
+    if (final) {
+        settle(size);
+        if (j < size) {
+            ranges.push_back(WordRange(begin + j, end - 1));
+            j = size;
+        }
+    }
+    scan.state = state;
+    scan.p = p;
+    scan.i = i;
+    scan.j = j;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
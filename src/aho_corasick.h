@@ -0,0 +1,135 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  aho_corasick.h 
+ *    Description:  Aho-Corasick自动机, 一次线性扫描完成停用词的最左最长匹配 
+ * 
+ *        Created:  2022/03/16 14:42:07
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_AHO_CORASICK_H
+#define TEXT_ANALYSIS_AHO_CORASICK_H
+
+#include <algorithm>
+#include <vector>
+
+#include "unicode.h"
+#include "dict_trie.h"
+#include "ascii_scanner.h"
+
+namespace text_analysis {
+
+// 匹配语义与 Trie::find + 逐位置取最长词 一致:
+// 从左到右, 当前位置存在词时取最长的词并跳过, 否则前进一个rune
+// 节点按BFS顺序编号, 子节点按rune排序连续存放; 扫描过程不分配内存
+class AhoCorasick {
+public:
+    // 长度超过max_word_len的词忽略
+    AhoCorasick(const DictTrie& dict_trie, size_t max_word_len);
+    ~AhoCorasick() {
+    }
+
+    bool empty() const {
+        return max_length_ == 0;
+    }
+    // 最长词的rune数, 某个位置的匹配结果只取决于其后这么多个rune
+    size_t maxLength() const {
+        return max_length_;
+    }
+
+    // 分多次扫描(流式输入)时保存的进度, 位置均为相对于begin的rune下标
+    struct Scan {
+        int32_t state = 0;
+        // 下一个待扫描的位置
+        size_t p = 0;
+        // 下一个待确定的起点
+        size_t i = 0;
+        // 当前保留片段的起点, 之前的片段都已输出
+        size_t j = 0;
+        // 未确定起点的最长词, 环形数组
+        std::vector<uint32_t> window;
+
+        // 重新开始, 之前的扫描必须以final结束(窗口已清空)
+        void reset() {
+            state = 0;
+            p = i = j = 0;
+        }
+        // begin向后移动n(不超过j)
+        void shift(size_t n) {
+            p -= n;
+            i -= n;
+            j -= n;
+            if (!window.empty()) {
+                std::rotate(window.begin(), window.begin() + (n & (window.size() - 1)),
+                        window.end());
+            }
+        }
+    };
+
+    // 去掉匹配到的词, 剩余的连续片段追加到ranges
+    // runes由text解码得到, 不可能开始一个词的ascii字符在text上批量跳过
+    // window为匹配用的滑动窗口, 由调用方复用
+    void removeMatches(const std::string& text,
+            RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            std::vector<WordRange>& ranges,
+            std::vector<uint32_t>& window) const;
+    // 从scan继续扫描到end, 只追加之后不会再变化的片段(其后的停用词已确定)
+    // final为true时输入已结束, 确定全部起点并追加最后一个片段, 结果与removeMatches一致
+    // 每个rune只扫描一次, 与分几次调用无关
+    void removeMatches(const std::string& text,
+            RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            bool final,
+            Scan& scan,
+            std::vector<WordRange>& ranges) const;
+private:
+    void insert(const Rune* word, size_t length);
+    void buildLinks();
+    int32_t child(int32_t node, Rune rune) const;
+    int32_t next(int32_t node, Rune rune) const {
+        int32_t t = child(node, rune);
+        while (t < 0 && node != 0) {
+            node = fail_[node];
+            t = child(node, rune);
+        }
+        return t < 0 ? 0 : t;
+    }
+private:
+    static const Rune ASCII_SIZE = 128;
+
+    // 构建期的节点, buildLinks之后转为下面的紧凑数组
+    struct BuildNode {
+        std::vector<std::pair<Rune, int32_t> > children;
+        uint32_t length = 0;
+        bool terminal = false;
+    };
+    std::vector<BuildNode> build_nodes_;
+
+    // 节点i的子节点为 child_runes_/child_nodes_[child_begin_[i], child_begin_[i+1])
+    std::vector<uint32_t> child_begin_;
+    std::vector<Rune> child_runes_;
+    std::vector<int32_t> child_nodes_;
+    // root的ascii子节点直接寻址
+    std::vector<int32_t> root_ascii_;
+    std::vector<int32_t> fail_;
+    // 以该节点结尾的最长的词所在节点(自身或者fail链上), 没有为-1
+    std::vector<int32_t> output_;
+    // output链上的下一个词
+    std::vector<int32_t> output_next_;
+    // 节点深度, 即词长
+    std::vector<uint32_t> depth_;
+    // 最长词的长度, 决定匹配窗口的大小
+    size_t max_length_ = 0;
+    // 词的首字符(ascii部分)
+    AsciiScanner start_scanner_;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_AHO_CORASICK_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,146 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  ascii_scanner.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/18 10:26:48
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <string.h>
+
+#include "ascii_scanner.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEXT_ANALYSIS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace text_analysis {
+
+namespace {
+
+SimdLevel detectSimdLevel() {
+#ifdef TEXT_ANALYSIS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return SIMD_SSE42;
+    }
+#endif
+    return SIMD_NONE;
+}
+
+}
+
+SimdLevel simdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+void AsciiScanner::clear() {
+    memset(table_, 0, sizeof(table_));
+    memset(lo_table_, 0, sizeof(lo_table_));
+    memset(hi_table_, 0, sizeof(hi_table_));
+    // 高半字节0~7对应一个bit, 8~15为非ascii, 单独用符号位判断
+    for (uint32_t hi = 0; hi < 8; hi++) {
+        hi_table_[hi] = 1 << hi;
+    }
+}
+
+void AsciiScanner::add(uint32_t c) {
+    if (c >= ASCII_SIZE) {
+        return;
+    }
+    table_[c] = true;
+    lo_table_[c & 0xf] |= 1 << (c >> 4);
+}
+
+size_t AsciiScanner::find(const char* data, size_t len) const {
+    switch (simdLevel()) {
+        case SIMD_AVX2:
+            return findAvx2(data, len);
+        case SIMD_SSE42:
+            return findSse(data, len);
+        default:
+            return findScalar(data, len);
+    }
+}
+
+size_t AsciiScanner::findScalar(const char* data, size_t len) const {
+    for (size_t i = 0; i < len; i++) {
+        if (contains(uint8_t(data[i]))) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef TEXT_ANALYSIS_X86_SIMD
+
+__attribute__((target("sse4.2")))
+size_t AsciiScanner::findSse(const char* data, size_t len) const {
+    const __m128i lo_table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo_table_));
+    const __m128i hi_table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi_table_));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i lo = _mm_shuffle_epi8(lo_table, _mm_and_si128(v, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        // 每个字节一位: 集合中的ascii | 非ascii
+        uint32_t mask = ~uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero)))
+            & 0xffff;
+        mask |= _mm_movemask_epi8(v);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + findScalar(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+size_t AsciiScanner::findAvx2(const char* data, size_t len) const {
+    const __m256i lo_table = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo_table_)));
+    const __m256i hi_table = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi_table_)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i lo = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(v, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hi_table,
+                _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        uint32_t mask = ~uint32_t(_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero)));
+        mask |= uint32_t(_mm256_movemask_epi8(v));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + findSse(data + i, len - i);
+}
+
+#else
+
+size_t AsciiScanner::findSse(const char* data, size_t len) const {
+    return findScalar(data, len);
+}
+
+size_t AsciiScanner::findAvx2(const char* data, size_t len) const {
+    return findScalar(data, len);
+}
+
+#endif
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,67 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  ascii_scanner.h 
+ *    Description:  utf8字节的向量化预扫描, 快速跳过不需要处理的ascii字符 
+ * 
+ *        Created:  2022/03/18 10:26:41
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_ASCII_SCANNER_H
+#define TEXT_ANALYSIS_ASCII_SCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace text_analysis {
+
+enum SimdLevel {
+    SIMD_NONE = 0,
+    SIMD_SSE42 = 1,
+    SIMD_AVX2 = 2,
+};
+
+// 运行时检测的x86向量指令集, 结果缓存
+SimdLevel simdLevel();
+
+// 查找第一个"需要处理"的字节: 非ascii字节, 或者属于指定集合的ascii字符
+// 其余字节都是单字节rune, 调用方可以按字节数直接跳过对应数量的rune
+// x86上按 AVX2(32字节) / SSE4.2(16字节) / 标量 运行时选择, 16字节块内用nibble查表分类
+class AsciiScanner {
+public:
+    AsciiScanner() {
+        clear();
+    }
+    ~AsciiScanner() {
+    }
+
+    void clear();
+    // 非ascii字符忽略(总是需要处理)
+    void add(uint32_t c);
+    bool contains(uint32_t c) const {
+        return c >= ASCII_SIZE || table_[c];
+    }
+
+    // 不存在返回len
+    size_t find(const char* data, size_t len) const;
+private:
+    size_t findScalar(const char* data, size_t len) const;
+    size_t findSse(const char* data, size_t len) const;
+    size_t findAvx2(const char* data, size_t len) const;
+private:
+    static const uint32_t ASCII_SIZE = 128;
+
+    bool table_[ASCII_SIZE];
+    // 字节c属于集合 <=> lo_table_[c & 0xf] & hi_table_[c >> 4] 不为0
+    uint8_t lo_table_[16];
+    uint8_t hi_table_[16];
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_ASCII_SCANNER_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
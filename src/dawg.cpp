@@ -0,0 +1,419 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dawg.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/23 17:12:15
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "dawg.h"
+
+namespace text_analysis {
+
+namespace {
+
+// 构建期的可变状态
+struct BuildState {
+    bool final = false;
+    // 从该状态出发可以到达的词数
+    uint32_t count = 0;
+    // 按rune升序
+    std::vector<std::pair<Rune, uint32_t> > trans;
+};
+
+// Daciuk增量构建: key按字典序依次加入, 新key与上一个key的公共前缀之后的路径不会再变化,
+// 这些状态自底向上与已登记的等价状态合并
+class DawgBuilder {
+public:
+    DawgBuilder(const PodArray<Rune>& runes, const PodArray<DictUnit>& units)
+        : runes_(runes), units_(units), registry_(0, StateHash(states_), StateEqual(states_)) {
+    }
+
+    void build();
+
+public:
+    std::vector<uint32_t> state_begin;
+    std::vector<uint8_t> finals;
+    std::vector<Rune> labels;
+    std::vector<uint32_t> targets;
+    std::vector<uint32_t> skips;
+    std::vector<int32_t> values;
+
+private:
+    struct StateHash {
+        explicit StateHash(const std::vector<BuildState>& states): states(states) {
+        }
+        size_t operator()(uint32_t s) const {
+            const BuildState& state = states[s];
+            size_t h = state.final ? 1 : 0;
+            for (size_t i = 0; i < state.trans.size(); i++) {
+                h = h * 1000003 ^ state.trans[i].first;
+                h = h * 1000003 ^ state.trans[i].second;
+            }
+            return h;
+        }
+        const std::vector<BuildState>& states;
+    };
+    struct StateEqual {
+        explicit StateEqual(const std::vector<BuildState>& states): states(states) {
+        }
+        bool operator()(uint32_t lhs, uint32_t rhs) const {
+            return states[lhs].final == states[rhs].final && states[lhs].trans == states[rhs].trans;
+        }
+        const std::vector<BuildState>& states;
+    };
+
+    const Rune* keyRunes(size_t i) const {
+        return runes_.data() + units_[i].offset;
+    }
+    size_t keySize(size_t i) const {
+        return units_[i].length;
+    }
+    void insert(const Rune* key, size_t len, size_t prefix_len);
+    // 合并路径上 [down_to, unchecked_.size()) 的状态
+    void minimize(size_t down_to);
+    void updateCount(uint32_t s);
+    void flatten();
+
+private:
+    const PodArray<Rune>& runes_;
+    const PodArray<DictUnit>& units_;
+    std::vector<BuildState> states_;
+    // 尚未合并的路径: 第i个状态为 states_[unchecked_[i]], 其父状态为第i-1个(或root)
+    std::vector<uint32_t> unchecked_;
+    std::unordered_set<uint32_t, StateHash, StateEqual> registry_;
+};
+
+void DawgBuilder::build() {
+    states_.push_back(BuildState());
+    // 按rune字典序排列, stable保证重复key时后加入的排在后面
+    std::vector<uint32_t> order(units_.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return std::lexicographical_compare(keyRunes(lhs), keyRunes(lhs) + keySize(lhs),
+                keyRunes(rhs), keyRunes(rhs) + keySize(rhs));
+    });
+
+    const Rune* prev = NULL;
+    size_t prev_len = 0;
+    for (size_t k = 0; k < order.size(); k++) {
+        const Rune* key = keyRunes(order[k]);
+        size_t len = keySize(order[k]);
+        // 空key不记录
+        if (len == 0) {
+            continue;
+        }
+        size_t prefix_len = 0;
+        if (prev != NULL) {
+            size_t max_len = std::min(len, prev_len);
+            while (prefix_len < max_len && key[prefix_len] == prev[prefix_len]) {
+                prefix_len++;
+            }
+        }
+        // 重复key以最后一个为准
+        if (prev != NULL && prefix_len == len && prefix_len == prev_len) {
+            values.back() = order[k];
+            continue;
+        }
+        insert(key, len, prefix_len);
+        values.push_back(order[k]);
+        prev = key;
+        prev_len = len;
+    }
+    minimize(0);
+    flatten();
+}
+
+void DawgBuilder::insert(const Rune* key, size_t len, size_t prefix_len) {
+    minimize(prefix_len);
+    uint32_t state = prefix_len == 0 ? 0 : unchecked_.back();
+    for (size_t i = prefix_len; i < len; i++) {
+        uint32_t child = states_.size();
+        states_.push_back(BuildState());
+        states_[state].trans.push_back(std::make_pair(key[i], child));
+        unchecked_.push_back(child);
+        state = child;
+    }
+    states_[state].final = true;
+}
+
+void DawgBuilder::minimize(size_t down_to) {
+    while (unchecked_.size() > down_to) {
+        uint32_t child = unchecked_.back();
+        unchecked_.pop_back();
+        uint32_t parent = unchecked_.empty() ? 0 : unchecked_.back();
+        std::unordered_set<uint32_t, StateHash, StateEqual>::const_iterator it =
+            registry_.find(child);
+        // 子状态都已登记, 登记顺序即拓扑序
+        updateCount(child);
+        if (it != registry_.end()) {
+            // 合并后child不再被引用, 释放转移表
+            states_[parent].trans.back().second = *it;
+            std::vector<std::pair<Rune, uint32_t> >().swap(states_[child].trans);
+        } else {
+            registry_.insert(child);
+        }
+    }
+}
+
+void DawgBuilder::updateCount(uint32_t s) {
+    BuildState& state = states_[s];
+    state.count = state.final ? 1 : 0;
+    for (size_t i = 0; i < state.trans.size(); i++) {
+        state.count += states_[state.trans[i].second].count;
+    }
+}
+
+// 可达状态按BFS重新编号, 并计算每条边跳过的词数
+void DawgBuilder::flatten() {
+    std::vector<uint32_t> ids(states_.size(), uint32_t(-1));
+    std::vector<uint32_t> queue(1, 0);
+    ids[0] = 0;
+    for (size_t head = 0; head < queue.size(); head++) {
+        const BuildState& state = states_[queue[head]];
+        for (size_t i = 0; i < state.trans.size(); i++) {
+            uint32_t t = state.trans[i].second;
+            if (ids[t] == uint32_t(-1)) {
+                ids[t] = queue.size();
+                queue.push_back(t);
+            }
+        }
+    }
+
+    state_begin.reserve(queue.size() + 1);
+    finals.reserve(queue.size());
+    state_begin.push_back(0);
+    for (size_t k = 0; k < queue.size(); k++) {
+        const BuildState& state = states_[queue[k]];
+        uint32_t skip = state.final ? 1 : 0;
+        for (size_t i = 0; i < state.trans.size(); i++) {
+            uint32_t t = state.trans[i].second;
+            labels.push_back(state.trans[i].first);
+            targets.push_back(ids[t]);
+            skips.push_back(skip);
+            skip += states_[t].count;
+        }
+        state_begin.push_back(labels.size());
+        finals.push_back(state.final ? 1 : 0);
+    }
+    std::vector<BuildState>().swap(states_);
+}
+
+}
+
+Dawg::Dawg(const PodArray<Rune>& runes, PodArray<DictUnit>& units, std::vector<double>& weights) {
+    DawgBuilder builder(runes, units);
+    builder.build();
+    state_begin_.assign(builder.state_begin);
+    finals_.assign(builder.finals);
+    labels_.assign(builder.labels);
+    targets_.assign(builder.targets);
+    skips_.assign(builder.skips);
+    // 按排名重新排列, 之后不再引用runes; offset置0, 见DictUnit
+    std::vector<DictUnit> ranked(builder.values.size());
+    std::vector<double> ranked_weights(builder.values.size());
+    for (size_t rank = 0; rank < ranked.size(); rank++) {
+        ranked[rank] = units[builder.values[rank]];
+        ranked[rank].offset = 0;
+        ranked_weights[rank] = weights[builder.values[rank]];
+    }
+    units.assign(ranked);
+    weights.swap(ranked_weights);
+    units_ = units.data();
+    buildRootAscii();
+}
+
+void Dawg::buildRootAscii() {
+    root_ascii_.assign(ASCII_SIZE, -1);
+    for (uint32_t t = state_begin_[0]; t < state_begin_[1] && labels_[t] < ASCII_SIZE; t++) {
+        root_ascii_[labels_[t]] = t;
+    }
+}
+
+bool Dawg::load(const DictImage& image, const PodArray<DictUnit>& units) {
+    if (!image.getSection(SECTION_DAWG_STATES, state_begin_)
+            || !image.getSection(SECTION_DAWG_FINALS, finals_)
+            || !image.getSection(SECTION_DAWG_LABELS, labels_)
+            || !image.getSection(SECTION_DAWG_TARGETS, targets_)
+            || !image.getSection(SECTION_DAWG_SKIPS, skips_)) {
+        return false;
+    }
+    if (finals_.empty() || state_begin_.size() != finals_.size() + 1
+            || labels_.size() != targets_.size() || labels_.size() != skips_.size()
+            || state_begin_[finals_.size()] != labels_.size()) {
+        return false;
+    }
+    for (size_t s = 0; s < finals_.size(); s++) {
+        if (state_begin_[s] > state_begin_[s + 1]) {
+            return false;
+        }
+    }
+    for (size_t t = 0; t < targets_.size(); t++) {
+        if (targets_[t] >= finals_.size()) {
+            return false;
+        }
+    }
+    if (!checkRanks(units.size())) {
+        return false;
+    }
+    buildRootAscii();
+    units_ = units.data();
+    return true;
+}
+
+// 非递归DFS自底向上计算每个状态出发的词数, 有环时失败
+bool Dawg::checkRanks(size_t unit_count) const {
+    const size_t state_count = finals_.size();
+    const uint64_t limit = unit_count;
+    // 0: 未访问, 1: 在栈中, 2: 已完成
+    std::vector<uint8_t> colors(state_count, 0);
+    std::vector<uint64_t> counts(state_count, 0);
+    // (状态, 下一条待访问的边)
+    std::vector<std::pair<uint32_t, uint32_t> > stack(1, std::make_pair(0, state_begin_[0]));
+    colors[0] = 1;
+    while (!stack.empty()) {
+        uint32_t s = stack.back().first;
+        uint32_t& edge = stack.back().second;
+        if (edge < state_begin_[s + 1]) {
+            uint32_t t = targets_[edge++];
+            if (colors[t] == 1) {
+                return false;
+            }
+            if (colors[t] == 0) {
+                colors[t] = 1;
+                stack.push_back(std::make_pair(t, state_begin_[t]));
+            }
+            continue;
+        }
+        uint64_t count = finals_[s] ? 1 : 0;
+        for (uint32_t e = state_begin_[s]; e < state_begin_[s + 1]; e++) {
+            count += counts[targets_[e]];
+            if (count > limit) {
+                return false;
+            }
+        }
+        for (uint32_t e = state_begin_[s]; e < state_begin_[s + 1]; e++) {
+            if (uint64_t(skips_[e]) + counts[targets_[e]] > count) {
+                return false;
+            }
+        }
+        counts[s] = count;
+        colors[s] = 2;
+        stack.pop_back();
+    }
+    return true;
+}
+
+void Dawg::save(DictImageWriter& writer) const {
+    writer.addSection(SECTION_DAWG_STATES, state_begin_);
+    writer.addSection(SECTION_DAWG_FINALS, finals_);
+    writer.addSection(SECTION_DAWG_LABELS, labels_);
+    writer.addSection(SECTION_DAWG_TARGETS, targets_);
+    writer.addSection(SECTION_DAWG_SKIPS, skips_);
+}
+
+void Dawg::getNodeStats(NodeStats& stats) const {
+    stats.node_count = stateCount();
+    stats.bytes = memoryUsage();
+    stats.branching.assign(NodeStats::MAX_BRANCHING + 1, 0);
+    for (size_t s = 0; s < stateCount(); s++) {
+        size_t children = state_begin_[s + 1] - state_begin_[s];
+        stats.branching[std::min(children, NodeStats::MAX_BRANCHING)]++;
+    }
+}
+
+const DictUnit* Dawg::find(RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end) const {
+    if (begin == end) {
+        return NULL;
+    }
+
+    int32_t state = 0;
+    uint32_t rank = 0;
+    for (RuneStringArray::const_iterator it = begin; it != end; it++) {
+        state = next(state, it->rune, rank);
+        if (state < 0) {
+            return NULL;
+        }
+    }
+    return getValue(state, rank);
+}
+
+const DictUnit* Dawg::findWord(const char* word, size_t len) const {
+    if (len == 0) {
+        return NULL;
+    }
+    int32_t state = 0;
+    uint32_t rank = 0;
+    // 不超过4字节, 不分配内存
+    std::string bytes;
+    for (size_t pos = 0; pos < len;) {
+        RuneString rs = decodeRuneFromUtf8(word + pos, len - pos);
+        if (rs.len == 0) {
+            return NULL;
+        }
+        // 非规范的编码(超长编码、后续字节错误)不是词典中的词
+        bytes.clear();
+        encodeRuneToUtf8(rs.rune, bytes);
+        if (bytes.size() != rs.len || bytes.compare(0, rs.len, word + pos, rs.len) != 0) {
+            return NULL;
+        }
+        state = next(state, rs.rune, rank);
+        if (state < 0) {
+            return NULL;
+        }
+        pos += rs.len;
+    }
+    return getValue(state, rank);
+}
+
+// 每个状态: 自身为词时排名0为自身, 否则取skip不超过rank的最后一条边继续
+void Dawg::getKey(size_t rank, std::vector<Rune>& key) const {
+    key.clear();
+    uint32_t state = 0;
+    while (!finals_[state] || rank > 0) {
+        const uint32_t* begin = skips_.data() + state_begin_[state];
+        const uint32_t* end = skips_.data() + state_begin_[state + 1];
+        const uint32_t* it = std::upper_bound(begin, end, rank);
+        if (it == begin) {
+            // 排名超出词数
+            key.clear();
+            return;
+        }
+        size_t t = it - 1 - skips_.data();
+        rank -= skips_[t];
+        key.push_back(labels_[t]);
+        state = targets_[t];
+    }
+}
+
+// 与Trie::find的结果一致: 首字总是记录(不是词时为NULL), 之后只记录词尾
+void Dawg::find(RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        Lattice& lattice,
+        size_t max_word_len) const {
+    lattice.reset();
+    for (size_t i = 0; i < size_t(end - begin); i++) {
+        RuneStringArray::const_iterator word_end = begin + std::min(size_t(end - begin), i + max_word_len);
+        findPrefixes(begin + i, word_end, [&lattice, i](size_t k, const DictUnit* unit) {
+            lattice.addEdge(i + k, unit);
+        });
+        lattice.closePosition();
+    }
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
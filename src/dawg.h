@@ -0,0 +1,134 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dawg.h 
+ *    Description:  最小化的词典自动机(DAWG), 相同的后缀子树只保存一份 
+ * 
+ *        Created:  2022/03/23 17:12:09
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_DAWG_H
+#define TEXT_ANALYSIS_DAWG_H
+
+#include <algorithm>
+#include <vector>
+
+#include "unicode.h"
+#include "pod_array.h"
+#include "dict_image.h"
+#include "trie.h"
+
+namespace text_analysis {
+
+// 与Trie的查询接口一致, 用于 -kan/-nya/-an 这类后缀大量重复的词典, 以查询速度换内存
+// 后缀合并之后节点不再对应唯一的词, 词的下标通过路径计数得到:
+//   每条边记录经过它之前跳过的词数(节点自身为词 + 排在前面的兄弟子树中的词),
+//   沿路径累加即为该词在字典序中的排名; DictUnit按排名存放, 排名即下标
+// 词的rune不再单独保存: 精确查词沿自动机匹配utf8, 由排名反向走一遍即可还原词
+class Dawg {
+public:
+    Dawg() {
+    }
+    // 第i个key为 units[i] 在runes中对应的词, 权重为weights[i], 重复的key以最后一个为准
+    // 构建之后units与weights按key的字典序重新排列(去掉重复的key), 下标即排名, offset不再有效
+    Dawg(const PodArray<Rune>& runes, PodArray<DictUnit>& units, std::vector<double>& weights);
+    ~Dawg() {
+    }
+    Dawg(const Dawg&) = delete;
+    Dawg& operator=(const Dawg&) = delete;
+
+    // 校验全部下标以及路径计数都在数组范围内(排名小于units.size()), 损坏的镜像返回false
+    bool load(const DictImage& image, const PodArray<DictUnit>& units);
+    void save(DictImageWriter& writer) const;
+
+    size_t memoryUsage() const {
+        return state_begin_.bytes() + finals_.bytes() + labels_.bytes()
+            + targets_.bytes() + skips_.bytes() + root_ascii_.size() * sizeof(int32_t);
+    }
+    size_t stateCount() const {
+        return finals_.size();
+    }
+
+    void find(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            Lattice& lattice,
+            size_t max_word_len) const;
+
+    const DictUnit* find(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end) const;
+    // 精确查词, 逐个字符解码word, 只接受encodeRuneToUtf8的输出(与按utf8字节查完美哈希一致)
+    const DictUnit* findWord(const char* word, size_t len) const;
+    // 排名为rank(即DictUnit下标)的词
+    void getKey(size_t rank, std::vector<Rune>& key) const;
+
+    // 与Trie::findPrefixes一致
+    template <class Visit>
+    void findPrefixes(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            Visit visit) const {
+        if (begin == end) {
+            return;
+        }
+        uint32_t rank = 0;
+        int32_t state = next(0, begin->rune, rank);
+        visit(0, state >= 0 ? getValue(state, rank) : NULL);
+        for (size_t k = 1; state >= 0 && k < size_t(end - begin); k++) {
+            state = next(state, (begin + k)->rune, rank);
+            if (state >= 0 && finals_[state]) {
+                visit(k, getValue(state, rank));
+            }
+        }
+    }
+
+    void getNodeStats(NodeStats& stats) const;
+private:
+    // 状态转移, 成功时rank累加跳过的词数
+    int32_t next(int32_t state, Rune rune, uint32_t& rank) const {
+        size_t t = 0;
+        if (state == 0 && rune < ASCII_SIZE) {
+            if (root_ascii_[rune] < 0) {
+                return -1;
+            }
+            t = root_ascii_[rune];
+        } else {
+            const Rune* begin = labels_.data() + state_begin_[state];
+            const Rune* end = labels_.data() + state_begin_[state + 1];
+            const Rune* it = std::lower_bound(begin, end, rune);
+            if (it == end || *it != rune) {
+                return -1;
+            }
+            t = it - labels_.data();
+        }
+        rank += skips_[t];
+        return targets_[t];
+    }
+    void buildRootAscii();
+    const DictUnit* getValue(int32_t state, uint32_t rank) const {
+        return finals_[state] ? units_ + rank : NULL;
+    }
+    // 每个状态出发的词数不超过unit_count, 且每条边跳过的词数加上目标状态的词数不超过所在状态的词数,
+    // 沿任意路径累加的rank都小于unit_count
+    bool checkRanks(size_t unit_count) const;
+private:
+    static const Rune ASCII_SIZE = 128;
+
+    // 状态s的出边为 [state_begin_[s], state_begin_[s+1]), 按rune升序, 0为初始状态
+    PodArray<uint32_t> state_begin_;
+    PodArray<uint8_t> finals_;
+    PodArray<Rune> labels_;
+    PodArray<uint32_t> targets_;
+    PodArray<uint32_t> skips_;
+    // 初始状态的出边最多, 每个位置都从这里开始, ascii直接寻址(边的下标, 没有为-1), 不写入镜像
+    std::vector<int32_t> root_ascii_;
+    // 按排名存放的DictUnit
+    const DictUnit* units_ = NULL;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_DAWG_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
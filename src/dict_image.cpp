@@ -0,0 +1,152 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dict_image.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/02 15:32:46
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <string.h>
+#include <fstream>
+
+#include "dict_image.h"
+
+namespace text_analysis {
+
+// 每次处理8字节, 只用于检测文件损坏/截断
+uint64_t calcChecksum(const char* data, size_t len, uint64_t seed) {
+    uint64_t h = seed;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        h = (h ^ w) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    for (; i < len; i++) {
+        h = (h ^ uint8_t(data[i])) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static size_t alignSize(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+// header中除checksum以外的字段都参与计算, min_weight等损坏时同样能发现
+static uint64_t calcHeaderChecksum(const DictImageHeader& header, const DictImageSection* table) {
+    DictImageHeader copy = header;
+    copy.checksum = 0;
+    uint64_t h = calcChecksum(reinterpret_cast<const char*>(&copy), sizeof(copy));
+    return calcChecksum(reinterpret_cast<const char*>(table),
+        sizeof(DictImageSection) * header.section_count, h);
+}
+
+bool DictImageWriter::write(const std::string& path,
+        double freq_sum,
+        double min_weight,
+        double max_weight) const {
+    DictImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DICT_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = DICT_IMAGE_VERSION;
+    header.byte_order = DICT_IMAGE_BYTE_ORDER;
+    header.freq_sum = freq_sum;
+    header.min_weight = min_weight;
+    header.max_weight = max_weight;
+    header.section_count = sections_.size();
+
+    // section表 + 数据, 全部放在内存中再计算校验和
+    std::vector<DictImageSection> table(sections_.size());
+    size_t offset = alignSize(sizeof(header) + sizeof(DictImageSection) * table.size());
+    for (size_t i = 0; i < sections_.size(); i++) {
+        table[i].id = sections_[i].id;
+        table[i].elem_size = sections_[i].elem_size;
+        table[i].offset = offset;
+        table[i].count = sections_[i].count;
+        table[i].checksum = calcChecksum(sections_[i].data, sections_[i].elem_size * sections_[i].count);
+        offset = alignSize(offset + sections_[i].elem_size * sections_[i].count);
+    }
+    header.file_size = offset;
+    header.checksum = calcHeaderChecksum(header, table.data());
+    std::string body(offset - sizeof(header), '\0');
+    if (!table.empty()) {
+        memcpy(&body[0], table.data(), sizeof(DictImageSection) * table.size());
+    }
+    for (size_t i = 0; i < sections_.size(); i++) {
+        size_t bytes = sections_[i].elem_size * sections_[i].count;
+        if (bytes > 0) {
+            memcpy(&body[table[i].offset - sizeof(header)], sections_[i].data, bytes);
+        }
+    }
+
+    std::ofstream outfile(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (outfile.fail()) {
+        return false;
+    }
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outfile.write(body.data(), body.size());
+    outfile.close();
+    return !outfile.fail();
+}
+
+bool DictImage::open(const std::string& path, bool verify_sections) {
+    if (!file_.open(path) || file_.size() < sizeof(DictImageHeader)) {
+        file_.close();
+        return false;
+    }
+    const char* addr = file_.data();
+    size_t size = file_.size();
+    const DictImageHeader& h = header();
+    if (memcmp(h.magic, DICT_IMAGE_MAGIC, sizeof(h.magic)) != 0
+            || h.version != DICT_IMAGE_VERSION
+            || h.byte_order != DICT_IMAGE_BYTE_ORDER
+            || h.file_size != size
+            || sizeof(DictImageHeader) + sizeof(DictImageSection) * uint64_t(h.section_count) > size) {
+        file_.close();
+        return false;
+    }
+    const DictImageSection* table = reinterpret_cast<const DictImageSection*>(addr + sizeof(h));
+    if (calcHeaderChecksum(h, table) != h.checksum) {
+        file_.close();
+        return false;
+    }
+    // section数据不能与header/section表重叠
+    const uint64_t table_end = sizeof(h) + sizeof(DictImageSection) * uint64_t(h.section_count);
+    for (uint32_t i = 0; i < h.section_count; i++) {
+        const DictImageSection& section = table[i];
+        if (section.offset % 8 != 0 || section.offset < table_end || section.offset > size
+                || section.elem_size == 0
+                || section.count > (size - section.offset) / section.elem_size) {
+            file_.close();
+            return false;
+        }
+        if (verify_sections && calcChecksum(addr + section.offset,
+                    section.elem_size * section.count) != section.checksum) {
+            file_.close();
+            return false;
+        }
+    }
+    return true;
+}
+
+const DictImageSection* DictImage::findSection(uint32_t id) const {
+    if (file_.data() == NULL) {
+        return NULL;
+    }
+    const DictImageSection* table = reinterpret_cast<const DictImageSection*>(file_.data() + sizeof(DictImageHeader));
+    for (uint32_t i = 0; i < header().section_count; i++) {
+        if (table[i].id == id) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,155 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dict_image.h 
+ *    Description:  预编译的二进制词典镜像, 只读mmap加载 
+ * 
+ *        Created:  2022/03/02 15:32:40
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_DICT_IMAGE_H
+#define TEXT_ANALYSIS_DICT_IMAGE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "pod_array.h"
+#include "mapped_file.h"
+
+namespace text_analysis {
+
+// 格式变化时需要升级版本号, 旧镜像需要重新编译
+const uint32_t DICT_IMAGE_VERSION = 1;
+const char DICT_IMAGE_MAGIC[8] = {'T', 'A', 'D', 'I', 'C', 'T', '\0', '\0'};
+// 区分大小端
+const uint32_t DICT_IMAGE_BYTE_ORDER = 0x01020304;
+
+enum DictImageSectionId {
+    SECTION_CODE_INDEX = 1,
+    SECTION_CODE_PAGES = 2,
+    SECTION_BASE = 3,
+    SECTION_CHECK = 4,
+    SECTION_VALUES = 5,
+    SECTION_UNITS = 6,
+    SECTION_RUNES = 7,
+    SECTION_HASH_PARAMS = 8,
+    SECTION_HASH_PILOTS = 9,
+    SECTION_HASH_FINGERPRINTS = 10,
+    SECTION_HASH_VALUES = 11,
+    SECTION_HASH_REMAP = 12,
+    // DAWG布局, 与 SECTION_CODE_INDEX ~ SECTION_VALUES 以及 SECTION_RUNES、SECTION_HASH_* 二选一
+    SECTION_DAWG_STATES = 13,
+    SECTION_DAWG_FINALS = 14,
+    SECTION_DAWG_LABELS = 15,
+    SECTION_DAWG_TARGETS = 16,
+    SECTION_DAWG_SKIPS = 17,
+    // 权重, 与units一一对应, 按权重类型三选一
+    SECTION_WEIGHTS = 18,
+    SECTION_FIXED_WEIGHTS16 = 19,
+    SECTION_FIXED_WEIGHTS32 = 20,
+};
+
+// 文件布局: header | section表 | 各section数据(8字节对齐)
+struct DictImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    // header(本字段按0计算)与section表的校验和, 每次打开都校验
+    uint64_t checksum;
+    double freq_sum;
+    double min_weight;
+    double max_weight;
+    uint32_t section_count;
+    uint32_t reserved;
+}; // struct DictImageHeader
+
+struct DictImageSection {
+    uint32_t id;
+    uint32_t elem_size;
+    uint64_t offset;
+    uint64_t count;
+    // 本section数据的校验和, 只在完整校验时计算
+    uint64_t checksum;
+}; // struct DictImageSection
+
+const uint64_t CHECKSUM_SEED = 0xcbf29ce484222325ULL;
+
+// 可以分段计算: 上一段的结果作为下一段的seed
+uint64_t calcChecksum(const char* data, size_t len, uint64_t seed = CHECKSUM_SEED);
+
+class DictImageWriter {
+public:
+    DictImageWriter() {
+    }
+    ~DictImageWriter() {
+    }
+
+    // 只记录指针, write之前数据需要保持有效
+    template <typename T>
+    void addSection(uint32_t id, const PodArray<T>& values) {
+        Section section;
+        section.id = id;
+        section.elem_size = sizeof(T);
+        section.data = reinterpret_cast<const char*>(values.data());
+        section.count = values.size();
+        sections_.push_back(section);
+    }
+
+    bool write(const std::string& path, double freq_sum, double min_weight, double max_weight) const;
+private:
+    struct Section {
+        uint32_t id;
+        uint32_t elem_size;
+        const char* data;
+        uint64_t count;
+    };
+    std::vector<Section> sections_;
+};
+
+class DictImage {
+public:
+    DictImage() {
+    }
+    ~DictImage() {
+    }
+    DictImage(const DictImage&) = delete;
+    DictImage& operator=(const DictImage&) = delete;
+
+    // mmap只读打开, 校验magic/版本/大小以及header与section表的校验和
+    // verify_sections 为true时再校验每个section的数据, 需要读入全部页面, 线上加载默认不做
+    bool open(const std::string& path, bool verify_sections = false);
+
+    const DictImageHeader& header() const {
+        return *reinterpret_cast<const DictImageHeader*>(file_.data());
+    }
+
+    // 数组直接指向映射内存, 生命周期不能超过DictImage
+    template <typename T>
+    bool getSection(uint32_t id, PodArray<T>& values) const {
+        const DictImageSection* section = findSection(id);
+        if (section == NULL || section->elem_size != sizeof(T)) {
+            return false;
+        }
+        values.attach(reinterpret_cast<const T*>(file_.data() + section->offset), section->count);
+        return true;
+    }
+
+    size_t size() const {
+        return file_.size();
+    }
+private:
+    const DictImageSection* findSection(uint32_t id) const;
+private:
+    MappedFile file_;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_DICT_IMAGE_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
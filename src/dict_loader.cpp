@@ -0,0 +1,288 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dict_loader.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/14 11:05:58
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "dict_loader.h"
+
+namespace text_analysis {
+
+// 绝大多数词频为整数, 直接累加; 带小数/指数的交给strtod
+bool parseFreq(const char* begin, const char* end, double& value) {
+    while (begin < end && *begin == ' ') {
+        begin++;
+    }
+    if (begin == end) {
+        return false;
+    }
+    const char* p = begin;
+    if (*p == '+') {
+        p++;
+    }
+    uint64_t integer = 0;
+    size_t digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+        integer = integer * 10 + (*p - '0');
+    }
+    if (p == end && digits > 0 && digits <= 18) {
+        value = double(integer);
+        return true;
+    }
+    char buf[64];
+    if (size_t(end - begin) >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, begin, end - begin);
+    buf[end - begin] = '\0';
+    char* parsed = NULL;
+    value = strtod(buf, &parsed);
+    return parsed == buf + (end - begin) && parsed != buf;
+}
+
+bool parseRune(const char* begin, const char* end, Rune& rune) {
+    if (begin == end || end - begin > 7) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (const char* p = begin; p < end; p++) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        value = value * 10 + (*p - '0');
+    }
+    if (value > 0x10ffff) {
+        return false;
+    }
+    rune = value;
+    return true;
+}
+
+bool DictLoader::open(const std::string& file_path) {
+    errors_.clear();
+    line_num_ = 0;
+    if (!file_.open(file_path, true)) {
+        return false;
+    }
+    cursor_ = file_.data();
+    return true;
+}
+
+bool DictLoader::nextLine(const char*& begin, const char*& end) {
+    const char* file_end = file_.data() + file_.size();
+    if (cursor_ == NULL || cursor_ >= file_end) {
+        return false;
+    }
+    begin = cursor_;
+    end = static_cast<const char*>(memchr(begin, '\n', file_end - begin));
+    if (end == NULL) {
+        end = file_end;
+        cursor_ = file_end;
+    } else {
+        cursor_ = end + 1;
+    }
+    line_num_++;
+    // 兼容\r\n
+    if (end > begin && *(end - 1) == '\r') {
+        end--;
+    }
+    while (begin < end && *begin == ' ') {
+        begin++;
+    }
+    while (end > begin && *(end - 1) == ' ') {
+        end--;
+    }
+    return true;
+}
+
+void DictLoader::addError(const char* reason) {
+    DictLoadError error;
+    error.line = line_num_;
+    error.reason = reason;
+    errors_.push_back(error);
+}
+
+// 暂不支持postag: word\tfreq\tpostag, 连续的\t视为一个
+const char* DictLoader::splitDictLine(const char* begin, const char* end,
+        const char*& word_end, double& freq) {
+    word_end = static_cast<const char*>(memchr(begin, '\t', end - begin));
+    if (word_end == NULL) {
+        return "missing frequency";
+    }
+    if (word_end == begin) {
+        return "empty word";
+    }
+    const char* freq_begin = word_end;
+    while (freq_begin < end && *freq_begin == '\t') {
+        freq_begin++;
+    }
+    const char* freq_end = static_cast<const char*>(memchr(freq_begin, '\t', end - freq_begin));
+    if (freq_end == NULL) {
+        freq_end = end;
+    }
+    if (freq_begin == freq_end) {
+        return "missing frequency";
+    }
+    if (!parseFreq(freq_begin, freq_end, freq) || !(freq > 0.0)) {
+        return "invalid frequency";
+    }
+    return NULL;
+}
+
+// rune数为词中utf8首字节的个数, 与解码结果只在utf8非法时不同
+void DictLoader::countDict(size_t& unit_count, size_t& rune_count) {
+    unit_count = 0;
+    rune_count = 0;
+    const char* begin = NULL;
+    const char* end = NULL;
+    const char* word_end = NULL;
+    double freq = 0.0;
+    while (nextLine(begin, end)) {
+        if (begin == end || *begin == '#' || splitDictLine(begin, end, word_end, freq) != NULL) {
+            continue;
+        }
+        unit_count++;
+        for (const char* p = begin; p < word_end; p++) {
+            rune_count += (static_cast<unsigned char>(*p) & 0xc0) != 0x80;
+        }
+    }
+    cursor_ = file_.data();
+    line_num_ = 0;
+}
+
+void DictLoader::loadDict(std::vector<Rune>& runes,
+        std::vector<DictUnit>& units,
+        std::vector<double>& weights) {
+    size_t unit_count = 0;
+    size_t rune_count = 0;
+    countDict(unit_count, rune_count);
+    units.reserve(units.size() + unit_count);
+    weights.reserve(weights.size() + unit_count);
+    runes.reserve(runes.size() + rune_count);
+
+    const char* begin = NULL;
+    const char* end = NULL;
+    const char* word_end = NULL;
+    double freq = 0.0;
+    DictUnit node_info = DictUnit();
+    while (nextLine(begin, end)) {
+        if (begin == end || *begin == '#') {
+            continue;
+        }
+        const char* reason = splitDictLine(begin, end, word_end, freq);
+        if (reason != NULL) {
+            addError(reason);
+            continue;
+        }
+        // utf8直接解码到目标存储, 失败时回滚
+        size_t old_size = runes.size();
+        const char* p = begin;
+        while (p < word_end) {
+            RuneString rp = decodeRuneFromUtf8(p, word_end - p);
+            if (rp.len == 0) {
+                break;
+            }
+            runes.push_back(rp.rune);
+            p += rp.len;
+        }
+        if (p != word_end) {
+            runes.resize(old_size);
+            addError("invalid utf-8");
+            continue;
+        }
+        node_info.offset = old_size;
+        node_info.length = runes.size() - old_size;
+        units.push_back(node_info);
+        weights.push_back(freq);
+    }
+}
+
+// 连续的空格视为一个
+const char* DictLoader::parseStopWord(const char* begin, const char* end,
+        std::vector<Rune>* runes, size_t& count) {
+    count = 0;
+    const char* p = begin;
+    while (p < end) {
+        const char* token_end = static_cast<const char*>(memchr(p, ' ', end - p));
+        if (token_end == NULL) {
+            token_end = end;
+        }
+        if (token_end != p) {
+            Rune rune = 0;
+            if (!parseRune(p, token_end, rune)) {
+                return "invalid code point";
+            }
+            if (runes != NULL) {
+                runes->push_back(rune);
+            }
+            count++;
+        }
+        p = token_end + 1;
+    }
+    return NULL;
+}
+
+// 与解析共用切分, 预留的大小与结果一致
+void DictLoader::countStopWords(size_t& unit_count, size_t& rune_count) {
+    unit_count = 0;
+    rune_count = 0;
+    const char* begin = NULL;
+    const char* end = NULL;
+    size_t count = 0;
+    while (nextLine(begin, end)) {
+        if (begin == end || *begin == '#' || parseStopWord(begin, end, NULL, count) != NULL) {
+            continue;
+        }
+        unit_count++;
+        rune_count += count;
+    }
+    cursor_ = file_.data();
+    line_num_ = 0;
+}
+
+void DictLoader::loadStopWords(std::vector<Rune>& runes,
+        std::vector<DictUnit>& units,
+        std::vector<double>& weights) {
+    size_t unit_count = 0;
+    size_t rune_count = 0;
+    countStopWords(unit_count, rune_count);
+    units.reserve(units.size() + unit_count);
+    weights.reserve(weights.size() + unit_count);
+    runes.reserve(runes.size() + rune_count);
+
+    const char* begin = NULL;
+    const char* end = NULL;
+    DictUnit node_info = DictUnit();
+    while (nextLine(begin, end)) {
+        // 注释
+        if (begin == end || *begin == '#') {
+            continue;
+        }
+        size_t old_size = runes.size();
+        size_t count = 0;
+        const char* reason = parseStopWord(begin, end, &runes, count);
+        if (reason != NULL) {
+            runes.resize(old_size);
+            addError(reason);
+            continue;
+        }
+        node_info.offset = old_size;
+        node_info.length = runes.size() - old_size;
+        units.push_back(node_info);
+        // 停用词权重默认为 0.0
+        weights.push_back(0.0);
+    }
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
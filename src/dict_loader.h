@@ -0,0 +1,84 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dict_loader.h 
+ *    Description:  流式词典解析, mmap后原地扫描, 不做逐行的字符串分配 
+ * 
+ *        Created:  2022/03/14 11:05:52
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_DICT_LOADER_H
+#define TEXT_ANALYSIS_DICT_LOADER_H
+
+#include <string>
+#include <vector>
+
+#include "unicode.h"
+#include "trie.h"
+#include "mapped_file.h"
+
+namespace text_analysis {
+
+// 格式错误的行, 行号从1开始
+struct DictLoadError {
+    size_t line;
+    std::string reason;
+}; // struct DictLoadError
+
+// 解析结果直接追加到目标存储:
+// 词的rune连续存放在runes中, units[i]记录第i个词的offset/length, weights[i]为其词频
+class DictLoader {
+public:
+    DictLoader() {
+    }
+    ~DictLoader() {
+    }
+
+    bool open(const std::string& file_path);
+
+    // 词频词典: word\tfreq[\tpostag], '#'开头为注释
+    void loadDict(std::vector<Rune>& runes,
+            std::vector<DictUnit>& units,
+            std::vector<double>& weights);
+    // 停用词词典: 每行为空格分隔的十进制unicode编码, 权重为0.0
+    void loadStopWords(std::vector<Rune>& runes,
+            std::vector<DictUnit>& units,
+            std::vector<double>& weights);
+
+    const std::vector<DictLoadError>& errors() const {
+        return errors_;
+    }
+private:
+    // 取下一行(去掉首尾空格), 文件结束返回false
+    bool nextLine(const char*& begin, const char*& end);
+    void addError(const char* reason);
+    // 计数与解析共用的切分, 返回错误原因, 正确的行返回NULL
+    // 词频词典: 词为[begin, word_end), freq为解析出的词频
+    const char* splitDictLine(const char* begin, const char* end,
+            const char*& word_end, double& freq);
+    // 停用词: 空格分隔的编码依次追加到runes(为NULL时只计数), count为编码个数
+    const char* parseStopWord(const char* begin, const char* end,
+            std::vector<Rune>* runes, size_t& count);
+    // 预扫一遍文件, 统计词数与rune数的上界, 用于一次性预留目标存储
+    // 与解析共用切分, 只有utf8非法的词典行会多算
+    void countDict(size_t& unit_count, size_t& rune_count);
+    void countStopWords(size_t& unit_count, size_t& rune_count);
+private:
+    MappedFile file_;
+    const char* cursor_ = NULL;
+    size_t line_num_ = 0;
+    std::vector<DictLoadError> errors_;
+};
+
+// 非抛异常的数字解析, 必须完整匹配[begin, end)
+bool parseFreq(const char* begin, const char* end, double& value);
+bool parseRune(const char* begin, const char* end, Rune& rune);
+
+}
+
+#endif  // TEXT_ANALYSIS_DICT_LOADER_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
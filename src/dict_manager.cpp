@@ -0,0 +1,311 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dict_manager.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/08 11:20:21
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <sstream>
+#include <unordered_set>
+
+#include "make_unique.h"
+#include "dict_manager.h"
+#include "logger.h"
+
+namespace text_analysis {
+
+static const char* formatName(DictFormat format) {
+    switch (format) {
+        case DICT_IMAGE:
+            return "image";
+        case DICT_TEXT_DAWG:
+            return "text_dawg";
+        default:
+            return "text";
+    }
+}
+
+std::unique_ptr<DictTrie> DictManager::load(const std::string& dict_path, DictFormat format) {
+    std::unique_ptr<DictTrie> dict_trie = std::make_unique<DictTrie>();
+    bool ok = false;
+    switch (format) {
+        case DICT_IMAGE:
+            ok = dict_trie->initImage(dict_path);
+            break;
+        case DICT_TEXT_DAWG:
+            ok = dict_trie->init(dict_path, DICT_LAYOUT_DAWG);
+            break;
+        default:
+            ok = dict_trie->init(dict_path);
+            break;
+    }
+    if (!ok) {
+        return std::unique_ptr<DictTrie>();
+    }
+    return dict_trie;
+}
+
+bool DictManager::add(const std::string& country, std::unique_ptr<DictTrie> dict_trie) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return addEntry(country, std::move(dict_trie));
+}
+
+void DictManager::add(std::vector<std::pair<std::string, std::unique_ptr<DictTrie> > >& dict_tries) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& item : dict_tries) {
+        if (item.second) {
+            addEntry(item.first, std::move(item.second));
+        }
+    }
+}
+
+bool DictManager::addEntry(const std::string& country, std::unique_ptr<DictTrie> dict_trie) {
+    if (entries_.find(country) != entries_.end()) {
+        return false;
+    }
+    std::unique_ptr<Entry> entry = std::make_unique<Entry>();
+    entry->bytes = dict_trie->memoryUsage();
+    entry->dict_trie = std::shared_ptr<const DictTrie>(dict_trie.release());
+    entries_.insert(std::make_pair(country, std::move(entry)));
+    return true;
+}
+
+void DictManager::registerDict(const std::string& country,
+        const std::string& dict_path,
+        DictFormat format) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.find(country) != entries_.end()) {
+        return;
+    }
+    std::unique_ptr<Entry> entry = std::make_unique<Entry>();
+    entry->path = dict_path;
+    entry->format = format;
+    entry->lazy = true;
+    entries_.insert(std::make_pair(country, std::move(entry)));
+}
+
+bool DictManager::reload(const std::string& country,
+        const std::string& dict_path,
+        DictFormat format) {
+    std::string base_country;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry* entry = findEntry(country);
+        if (entry != NULL) {
+            base_country = entry->base_country;
+        }
+    }
+    // 构建过程不持锁, 不影响正在进行的分词
+    std::unique_ptr<DictTrie> dict_trie = base_country.empty()
+        ? load(dict_path, format) : loadUserDict(base_country, dict_path);
+    if (!dict_trie) {
+        return false;
+    }
+    Entry* entry = NULL;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry = findEntry(country);
+        if (entry == NULL) {
+            return addEntry(country, std::move(dict_trie));
+        }
+    }
+    // 旧快照与被淘汰的词典在锁外释放
+    std::shared_ptr<const DictTrie> old_dict_trie;
+    std::vector<std::shared_ptr<const DictTrie> > victims;
+    {
+        // 等待进行中的按需加载结束, 避免旧路径的加载结果覆盖新词典
+        // entry不会被删除, 锁外持有指针是安全的
+        // 只在替换期间持有: 之后重建用户词典时get()可能重新加载同一地区
+        std::lock_guard<std::mutex> load_lock(entry->load_mutex);
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry->path = dict_path;
+        entry->format = format;
+        entry->failed = false;
+        entry->bytes = dict_trie->memoryUsage();
+        entry->last_used = ++clock_;
+        old_dict_trie.swap(entry->dict_trie);
+        entry->dict_trie = std::shared_ptr<const DictTrie>(dict_trie.release());
+        evict(entry, victims);
+    }
+    if (base_country.empty()) {
+        reloadUserDicts(country);
+    }
+    return true;
+}
+
+bool DictManager::addUserDict(const std::string& name,
+        const std::string& base_country,
+        const std::string& user_dict_path) {
+    std::unique_ptr<DictTrie> dict_trie = loadUserDict(base_country, user_dict_path);
+    if (!dict_trie) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!addEntry(name, std::move(dict_trie))) {
+        return false;
+    }
+    Entry* entry = findEntry(name);
+    entry->path = user_dict_path;
+    entry->base_country = base_country;
+    return true;
+}
+
+std::unique_ptr<DictTrie> DictManager::loadUserDict(const std::string& base_country,
+        const std::string& user_dict_path) {
+    std::shared_ptr<const DictTrie> base = get(base_country);
+    if (!base) {
+        return std::unique_ptr<DictTrie>();
+    }
+    std::unique_ptr<DictTrie> dict_trie = std::make_unique<DictTrie>();
+    if (!dict_trie->initUserDict(base, user_dict_path)) {
+        return std::unique_ptr<DictTrie>();
+    }
+    return dict_trie;
+}
+
+// 用户词典持有旧的地区词典, 按新的地区词典重建
+void DictManager::reloadUserDicts(const std::string& base_country) {
+    std::vector<std::pair<std::string, std::string> > user_dicts;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& iter : entries_) {
+            if (iter.second->base_country == base_country) {
+                user_dicts.push_back(std::make_pair(iter.first, iter.second->path));
+            }
+        }
+    }
+    for (const auto& item : user_dicts) {
+        reload(item.first, item.second, DICT_TEXT);
+    }
+}
+
+DictManager::Entry* DictManager::findEntry(const std::string& country) const {
+    auto iter = entries_.find(country);
+    if (iter == entries_.end()) {
+        return NULL;
+    }
+    return iter->second.get();
+}
+
+std::shared_ptr<const DictTrie> DictManager::get(const std::string& country) {
+    Entry* entry = NULL;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry = findEntry(country);
+        if (entry == NULL) {
+            return std::shared_ptr<const DictTrie>();
+        }
+        entry->last_used = ++clock_;
+        if (entry->dict_trie || !entry->lazy || entry->failed) {
+            return entry->dict_trie;
+        }
+    }
+    // 首次使用, 其余线程等待同一次加载
+    std::lock_guard<std::mutex> load_lock(entry->load_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entry->dict_trie || entry->failed) {
+            return entry->dict_trie;
+        }
+    }
+    std::shared_ptr<const DictTrie> dict_trie(load(entry->path, entry->format).release());
+    if (!dict_trie) {
+        // 失败会被缓存, 之后的查询直接返回空, 只在这里记录一次
+        // path/format只在持有load_mutex时修改
+        std::ostringstream message;
+        message << "[DictManager] failed to load dict " << country << ": " << entry->path
+            << " (format " << formatName(entry->format) << ")";
+        logMessage(message.str());
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry->failed = true;
+        return dict_trie;
+    }
+    // 在lock之后析构, 即锁外释放
+    std::vector<std::shared_ptr<const DictTrie> > victims;
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->dict_trie = dict_trie;
+    entry->bytes = dict_trie->memoryUsage();
+    entry->last_used = ++clock_;
+    evict(entry, victims);
+    return dict_trie;
+}
+
+CountryHandle DictManager::resolve(const std::string& country) {
+    CountryHandle handle;
+    handle.dict_trie_ = get(country);
+    if (handle.dict_trie_) {
+        // id地区 非ascii 不处理
+        handle.ascii_only_ = baseCountry(country) == "id";
+    }
+    return handle;
+}
+
+bool DictManager::contains(const std::string& country) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return findEntry(country) != NULL;
+}
+
+void DictManager::setMemoryBudget(size_t bytes) {
+    std::vector<std::shared_ptr<const DictTrie> > victims;
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_budget_ = bytes;
+    evict(NULL, victims);
+}
+
+size_t DictManager::memoryUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t total = 0;
+    for (const auto& iter : entries_) {
+        if (iter.second->dict_trie) {
+            total += iter.second->bytes;
+        }
+    }
+    return total;
+}
+
+// 持有mutex_时调用, keep为刚加载的词典, 不参与淘汰
+// 被淘汰的词典在最后一个使用者释放后析构; 管理器持有的引用移入victims, 避免在锁内析构整个词典
+void DictManager::evict(const Entry* keep,
+        std::vector<std::shared_ptr<const DictTrie> >& victims) {
+    if (memory_budget_ == 0) {
+        return;
+    }
+    size_t total = 0;
+    // 有用户词典的地区词典被用户词典持有, 淘汰后不释放内存, 再次使用时还会加载第二份
+    std::unordered_set<std::string> pinned;
+    for (const auto& iter : entries_) {
+        if (iter.second->dict_trie) {
+            total += iter.second->bytes;
+            if (!iter.second->base_country.empty()) {
+                pinned.insert(iter.second->base_country);
+            }
+        }
+    }
+    while (total > memory_budget_) {
+        Entry* victim = NULL;
+        for (const auto& iter : entries_) {
+            Entry* entry = iter.second.get();
+            if (!entry->lazy || !entry->dict_trie || entry == keep || pinned.count(iter.first) > 0) {
+                continue;
+            }
+            if (victim == NULL || entry->last_used < victim->last_used) {
+                victim = entry;
+            }
+        }
+        if (victim == NULL) {
+            break;
+        }
+        total -= victim->bytes;
+        victims.push_back(std::move(victim->dict_trie));
+        victim->dict_trie.reset();
+    }
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
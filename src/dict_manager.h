@@ -0,0 +1,137 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dict_manager.h 
+ *    Description:  按地区管理分词词典, 支持按需加载与内存预算淘汰 
+ * 
+ *        Created:  2022/03/08 11:20:15
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_DICT_MANAGER_H
+#define TEXT_ANALYSIS_DICT_MANAGER_H
+
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "dict_trie.h"
+
+namespace text_analysis {
+
+enum DictFormat {
+    DICT_TEXT = 0,   // 文本词典: word\tfreq
+    DICT_IMAGE = 1,  // dict_compiler 编译的二进制镜像
+    DICT_TEXT_DAWG = 2,  // 文本词典, 构建为DAWG布局(内存更小, 查询稍慢)
+};
+
+// 用户词典的注册名: country@tenant
+const char USER_DICT_SEPARATOR = '@';
+
+inline std::string userDictName(const std::string& country, const std::string& tenant) {
+    return country + USER_DICT_SEPARATOR + tenant;
+}
+// 注册名对应的地区, 普通词典即本身
+inline std::string baseCountry(const std::string& name) {
+    return name.substr(0, name.find(USER_DICT_SEPARATOR));
+}
+
+// 解析后的地区: 词典快照以及地区选项, 创建后不变, 可以多线程共享
+// 分词时不再按地区名查找词典或比较字符串; 持有期间词典不会被淘汰或替换, 热更新后需要重新获取
+class CountryHandle {
+public:
+    CountryHandle() {
+    }
+    // 词典不存在或者加载失败时无效
+    bool valid() const {
+        return dict_trie_ != NULL;
+    }
+    const DictTrie* dict() const {
+        return dict_trie_.get();
+    }
+    // 只对全ascii的片段做MM分词(id)
+    bool asciiOnly() const {
+        return ascii_only_;
+    }
+private:
+    friend class DictManager;
+    std::shared_ptr<const DictTrie> dict_trie_;
+    bool ascii_only_ = false;
+};
+
+// 地区 => 词典
+// (1) add: 直接加载, 常驻内存
+// (2) registerDict: 只记录路径, 第一次get时加载, 并发的首次调用只加载一次
+//     超出内存预算时按LRU淘汰按需加载的词典, 正在使用的词典由shared_ptr保证有效
+//     有用户词典叠加的地区词典不会被淘汰(用户词典持有它, 淘汰不释放内存)
+// (3) reload: 在锁外构建新词典, 加锁替换快照(RCU)
+//     正在分词的线程继续使用旧快照, 最后一个使用者释放后旧词典析构
+// (4) addUserDict: 用户词典叠加在地区词典之上, 与其他用户共享地区词典
+//     地区词典reload后, 其上的用户词典随之重建
+class DictManager {
+public:
+    DictManager() {
+    }
+    ~DictManager() {
+    }
+
+    // 地区已存在时不覆盖
+    bool add(const std::string& country, std::unique_ptr<DictTrie> dict_trie);
+    // 批量添加, 一次加锁全部发布
+    void add(std::vector<std::pair<std::string, std::unique_ptr<DictTrie> > >& dict_tries);
+    void registerDict(const std::string& country, const std::string& dict_path, DictFormat format);
+    // 热更新, 加载失败时保留旧词典; 地区不存在时直接添加
+    // 用户词典忽略format
+    bool reload(const std::string& country, const std::string& dict_path, DictFormat format);
+    // name已存在或者地区词典不存在时返回false
+    bool addUserDict(const std::string& name,
+            const std::string& base_country,
+            const std::string& user_dict_path);
+    // 不存在或者加载失败返回空
+    std::shared_ptr<const DictTrie> get(const std::string& country);
+    // get + 地区选项, 用户词典的选项与所属地区一致
+    CountryHandle resolve(const std::string& country);
+    bool contains(const std::string& country) const;
+
+    // 0 表示不限制
+    void setMemoryBudget(size_t bytes);
+    size_t memoryUsage() const;
+
+    static std::unique_ptr<DictTrie> load(const std::string& dict_path, DictFormat format);
+private:
+    struct Entry {
+        std::string path;
+        DictFormat format = DICT_TEXT;
+        bool lazy = false;
+        bool failed = false;
+        // 用户词典所属的地区, 普通词典为空
+        std::string base_country;
+        std::shared_ptr<const DictTrie> dict_trie;
+        size_t bytes = 0;
+        uint64_t last_used = 0;
+        // 保证同一地区只有一个线程在加载
+        std::mutex load_mutex;
+    };
+    // 持有mutex_时调用
+    bool addEntry(const std::string& country, std::unique_ptr<DictTrie> dict_trie);
+    Entry* findEntry(const std::string& country) const;
+    std::unique_ptr<DictTrie> loadUserDict(const std::string& base_country,
+            const std::string& user_dict_path);
+    void reloadUserDicts(const std::string& base_country);
+    // 被淘汰的快照移入victims, 由调用方在释放mutex_之后析构
+    void evict(const Entry* keep, std::vector<std::shared_ptr<const DictTrie> >& victims);
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<Entry> > entries_;
+    size_t memory_budget_ = 0;
+    uint64_t clock_ = 0;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_DICT_MANAGER_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
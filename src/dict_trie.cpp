@@ -10,11 +10,12 @@
  * 
  * =====================================================================================
  */
-#include <exception>
 #include <algorithm>
+#include <sstream>
 
 #include "dict_trie.h"
-#include "nlp_stringutil.h"
+#include "dict_loader.h"
+#include "logger.h"
 
 namespace text_analysis {
 
@@ -24,22 +25,19 @@ DictTrie::DictTrie(const std::string& dict_path) {
 
 // load词典, 区分语言
 // 一个实例只支持一个语言,暂不支持多国词典混合
-bool DictTrie::init(const std::string& dict_path) {
+bool DictTrie::init(const std::string& dict_path, DictLayout layout) {
     // 加载默认字典
     if (!loadDict(dict_path)) {
         return false;
     }
     // 计算词频
-    freq_sum_ = calcFreqSum(node_infos_);
+    freq_sum_ = calcFreqSum(word_weights_);
     // 默认字典的freq赋值
     setDefaultWordWeights();
     // 计算weights
-    calculateWeight(node_infos_, freq_sum_);
-    // 缩短
-    shrink(node_infos_);
+    calculateWeight(word_weights_, freq_sum_);
     // 构建trie树
-    createTrie(node_infos_);
-    return true;
+    return createTrie(layout);
 }
 
 bool DictTrie::initStopWords(const std::string& stop_words_path) {
@@ -48,113 +46,281 @@ bool DictTrie::initStopWords(const std::string& stop_words_path) {
         return false;
     }
     // 构建trie树
-    createTrie(node_infos_);
+    return createTrie();
+}
+
+bool DictTrie::initImage(const std::string& image_path, bool verify_sections) {
+    std::unique_ptr<DictImage> image(new DictImage());
+    if (!image->open(image_path, verify_sections)) {
+        return false;
+    }
+    if (!image->getSection(SECTION_UNITS, units_)) {
+        return false;
+    }
+    // 镜像中有DAWG数据时使用DAWG布局, 词按排名存放, 没有rune与完美哈希
+    std::unique_ptr<Trie> trie;
+    std::unique_ptr<Dawg> dawg(new Dawg());
+    if (!dawg->load(*image, units_)) {
+        dawg.reset();
+        trie.reset(new Trie());
+        if (!image->getSection(SECTION_RUNES, runes_)
+                || !checkUnits()
+                || !word_index_.load(*image, units_.size())
+                || !trie->load(*image, units_)) {
+            units_.clear();
+            runes_.clear();
+            return false;
+        }
+    }
+    if (!loadWeights(*image)) {
+        units_.clear();
+        runes_.clear();
+        return false;
+    }
+    delete trie_;
+    trie_ = trie.release();
+    dawg_ = std::move(dawg);
+    image_ = std::move(image);
+    freq_sum_ = image_->header().freq_sum;
+    min_weight_ = image_->header().min_weight;
+    max_weight_ = image_->header().max_weight;
     return true;
 }
 
-void DictTrie::createTrie(const std::vector<DictUnit>& dict_units) {
-    // assert(dict_units.size());
+bool DictTrie::loadWeights(const DictImage& image) {
+    return loadWeightTable<double>(image)
+        || loadWeightTable<int16_t>(image)
+        || loadWeightTable<int32_t>(image);
+}
 
-    std::vector<Unicode> words;
-    std::vector<const DictUnit*> value_pointers;
-    for (size_t i = 0 ; i < dict_units.size(); i++) {
-        words.push_back(dict_units[i].word);
-        value_pointers.push_back(&dict_units[i]);
+// 未登录字的定点权重由浮点的最小权重换算, 超出范围说明镜像损坏
+template <typename T>
+bool DictTrie::loadWeightTable(const DictImage& image) {
+    std::unique_ptr<WeightTable<T> > weights = std::make_unique<WeightTable<T> >();
+    if (!weights->load(image, image.header().min_weight) || weights->size() != units_.size()) {
+        return false;
     }
-    trie_ = new Trie(words, value_pointers);
+    weights_ = std::move(weights);
+    return true;
 }
 
-// 不支持postag
-bool DictTrie::makeNodeInfo(DictUnit& node_info,
-        const std::string& word, 
-        double weight) { 
-    if (!decodeRunesInString(word, node_info.word)) {
-        return false;
+bool DictTrie::checkUnits() const {
+    for (size_t i = 0; i < units_.size(); i++) {
+        if (uint64_t(units_[i].offset) + units_[i].length > runes_.size()) {
+            return false;
+        }
     }
-    node_info.weight = weight;
-    // TODO(philister): 补上postag功能
     return true;
 }
 
-bool DictTrie::makeNodeInfo(DictUnit& node_info,
-        const std::vector<std::string>& runes,
-        double weight) {
-    auto&& unicode = node_info.word;
-    unicode.clear();
-    unicode.reserve(runes.size());
-    for (const auto& rune : runes) {
-        unicode.push_back(std::stoull(rune));
+bool DictTrie::initUserDict(std::shared_ptr<const DictTrie> base,
+        const std::string& user_dict_path) {
+    if (!base || !loadDict(user_dict_path)) {
+        return false;
     }
-    node_info.weight = weight;
+    // weight与基础词典可比, 未登录字的惩罚也沿用基础词典
+    freq_sum_ = base->freq_sum_;
+    min_weight_ = base->min_weight_;
+    max_weight_ = base->max_weight_;
+    calculateWeight(word_weights_, freq_sum_);
+    if (!createTrie()) {
+        return false;
+    }
+    // 与基础词典的权重类型一致, 分词时两者的权重可以直接比较
+    // 基础词典没有浮点权重, 超出定点范围的用户词典无法叠加
+    if (!quantizeWeights(base->weightType())) {
+        return false;
+    }
+    base_ = base;
     return true;
 }
 
-bool DictTrie::loadDict(const std::string& file_path) {
-    std::ifstream infile;
-    infile.open(file_path.c_str());   //将文件流对象与文件连接起来 
-    if(infile.fail()){
+bool DictTrie::saveImage(const std::string& image_path) const {
+    if ((trie_ == NULL && !dawg_) || base_) {
         return false;
     }
-    std::string line;
-    DictUnit node_info;
-    while(getline(infile, line)) {
-        StringUtil::trim(line);
-        if (StringUtil::startsWith(line, "#")) {
-            continue;
-        }
-        auto buf = StringUtil::split(line, "\t", true);
-        if (buf.size() < 2) {continue;}
-        // 暂不支持postag: word\tfreq\tpostag
-        try {
-            makeNodeInfo(node_info,
-                buf[0],
-                std::stod(buf[1])
-            );
-            node_infos_.push_back(node_info);
-        } catch (const std::exception& e) {
-            continue;     
+    DictImageWriter writer;
+    writer.addSection(SECTION_UNITS, units_);
+    if (dawg_) {
+        dawg_->save(writer);
+    } else {
+        writer.addSection(SECTION_RUNES, runes_);
+        trie_->save(writer);
+        word_index_.save(writer);
+    }
+    weights_->save(writer);
+    return writer.write(image_path, freq_sum_, min_weight_, max_weight_);
+}
+
+bool DictTrie::quantizeWeights(DictWeightType type) {
+    if (type == weightType()) {
+        return true;
+    }
+    if (image_ || weightType() != DICT_WEIGHT_DOUBLE) {
+        return false;
+    }
+    switch (type) {
+        case DICT_WEIGHT_FIXED16:
+            return quantizeWeightTable<int16_t>();
+        case DICT_WEIGHT_FIXED32:
+            return quantizeWeightTable<int32_t>();
+        default:
+            return false;
+    }
+}
+
+// 截断后误差没有上界, 有超出范围的权重时保持浮点权重
+// 定点权重替换浮点权重, 只保留一份
+template <typename T>
+bool DictTrie::quantizeWeightTable() {
+    std::unique_ptr<WeightTable<T> > weights = std::make_unique<WeightTable<T> >();
+    if (!weights->quantize(*getWeightTable<double>(), min_weight_)) {
+        return false;
+    }
+    weights_ = std::move(weights);
+    return true;
+}
+
+void DictTrie::getStats(DictStats& stats) const {
+    stats.layout = layout();
+    stats.mapped = bool(image_);
+    stats.overlay = bool(base_);
+    stats.word_count = units_.size();
+    stats.max_word_length = 0;
+    for (size_t i = 0; i < units_.size(); i++) {
+        stats.max_word_length = std::max(stats.max_word_length, size_t(units_[i].length));
+    }
+    stats.unit_bytes = units_.bytes();
+    stats.key_bytes = runes_.bytes();
+    stats.hash_bytes = word_index_.memoryUsage();
+    stats.weight_type = weightType();
+    stats.weight_bytes = weights_->bytes();
+    if (dawg_) {
+        dawg_->getNodeStats(stats.nodes);
+    } else if (trie_ != NULL) {
+        trie_->getNodeStats(stats.nodes);
+    }
+    stats.total_bytes = memoryUsage();
+    stats.min_weight = min_weight_;
+    stats.max_weight = max_weight_;
+}
+
+// 完美哈希构建失败时findWord无法使用, 整个词典视为加载失败
+bool DictTrie::createTrie(DictLayout layout) {
+    units_.assign(node_infos_);
+    runes_.assign(word_runes_);
+    if (layout == DICT_LAYOUT_DAWG) {
+        // units_与权重按排名重新排列, 查询与还原词都只需要自动机, 不再保留rune与完美哈希
+        dawg_.reset(new Dawg(runes_, units_, word_weights_));
+        runes_.clear();
+    } else {
+        trie_ = new Trie(runes_, units_);
+        if (!createWordIndex()) {
+            return false;
         }
     }
-    infile.close();
+    std::unique_ptr<WeightTable<double> > weights = std::make_unique<WeightTable<double> >();
+    weights->assign(word_weights_, min_weight_);
+    weights_ = std::move(weights);
     return true;
 }
 
-bool DictTrie::loadStopWordsDict(const std::string& file_path) {
-    std::ifstream infile;
-    infile.open(file_path.c_str());   //将文件流对象与文件连接起来 
-    if(infile.fail()){
-        return false;
+void DictTrie::getWordRunes(const DictUnit& unit, std::vector<Rune>& word) const {
+    if (dawg_) {
+        dawg_->getKey(&unit - units_.data(), word);
+        return;
     }
-    std::string line;
-    DictUnit node_info;
-    while(getline(infile, line)) {
-        StringUtil::trim(line);
-        // 注释
-        if (StringUtil::startsWith(line, "#")) {
-            continue;
+    const Rune* runes = unitRunes(unit);
+    word.assign(runes, runes + unit.length);
+}
+
+// 完美哈希只比较64位指纹, 不在词典中的词有约2^-64的概率误命中, 这里排除
+bool DictTrie::sameWord(const DictUnit& unit, const char* word, size_t len) const {
+    const Rune* runes = unitRunes(unit);
+    const char* end = word + len;
+    for (size_t k = 0; k < unit.length; k++) {
+        RuneString rp = decodeRuneFromUtf8(word, end - word);
+        if (rp.len == 0 || rp.rune != runes[k]) {
+            return false;
         }
-        auto buf = StringUtil::split(line, " ", true);
-        if (buf.size() < 1) {continue;}
-        try {
-            // 停用词权重默认为 0.0
-            makeNodeInfo(node_info, buf, 0.0);
-            node_infos_.push_back(node_info);
-        } catch (const std::exception& e) {
-            continue;     
+        word += rp.len;
+    }
+    return word == end;
+}
+
+// 按utf8字节建立完美哈希, 与trie一致, 重复的词以最后一个为准
+bool DictTrie::createWordIndex() {
+    std::string keys;
+    std::vector<uint32_t> offsets;
+    keys.reserve(runes_.size());
+    offsets.reserve(units_.size() + 1);
+    offsets.push_back(0);
+    for (size_t i = 0; i < units_.size(); i++) {
+        const Rune* word = unitRunes(units_[i]);
+        for (size_t k = 0; k < units_[i].length; k++) {
+            encodeRuneToUtf8(word[k], keys);
         }
+        offsets.push_back(keys.size());
+    }
+    if (!word_index_.build(keys, offsets)) {
+        logMessage("[DictTrie] failed to build word index");
+        return false;
+    }
+    return true;
+}
+
+bool DictTrie::loadDict(const std::string& file_path) {
+    DictLoader loader;
+    if (!loader.open(file_path)) {
+        return false;
     }
-    infile.close();
+    // 暂不支持postag: word\tfreq\tpostag
+    loader.loadDict(word_runes_, node_infos_, word_weights_);
+    reportErrors(file_path, loader.errors());
     return true;
 }
 
+bool DictTrie::loadStopWordsDict(const std::string& file_path) {
+    DictLoader loader;
+    if (!loader.open(file_path)) {
+        return false;
+    }
+    loader.loadStopWords(word_runes_, node_infos_, word_weights_);
+    reportErrors(file_path, loader.errors());
+    return true;
+}
+
+// 格式错误的行跳过, 前若干条交给日志回调, 全部可由loadErrors()取得
+void DictTrie::reportErrors(const std::string& file_path, const std::vector<DictLoadError>& errors) {
+    load_errors_ = errors;
+    const size_t max_report = 10;
+    for (size_t i = 0; i < errors.size() && i < max_report; i++) {
+        std::ostringstream message;
+        message << "[DictTrie] " << file_path << ":" << errors[i].line
+            << ": " << errors[i].reason << ", skipped";
+        logMessage(message.str());
+    }
+    if (errors.size() > max_report) {
+        std::ostringstream message;
+        message << "[DictTrie] " << file_path << ": " << errors.size()
+            << " malformed lines in total";
+        logMessage(message.str());
+    }
+}
+
+// 一次遍历取最小/最大值, 不复制排序
 void DictTrie::setDefaultWordWeights() {
-    // assert(node_infos_.size() > 0);
-    // 默认顺序是字典序, 这样在建立trie树时会加快速度, 所以计算freq需要重排 
-    // 可能会存在内存和效率的损耗, 看具体情况处理
-    std::vector<DictUnit> temp_nodes = node_infos_;
-    std::sort(temp_nodes.begin(), temp_nodes.end(), weightCompare);
-    min_weight_ = temp_nodes.front().weight;
-    max_weight_ = temp_nodes.back().weight;
+    if (word_weights_.empty()) {
+        min_weight_ = 0.0;
+        max_weight_ = 0.0;
+        return;
+    }
+    min_weight_ = word_weights_.front();
+    max_weight_ = word_weights_.front();
+    for (size_t i = 1; i < word_weights_.size(); i++) {
+        min_weight_ = std::min(min_weight_, word_weights_[i]);
+        max_weight_ = std::max(max_weight_, word_weights_[i]);
+    }
 }
 
 }
@@ -13,12 +13,21 @@
 #ifndef TEXT_ANALYSIS_DICT_TRIE_H
 #define TEXT_ANALYSIS_DICT_TRIE_H
 
+#include <cassert>
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <functional>
+#include <memory>
 
+#include "make_unique.h"
 #include "unicode.h"
 #include "trie.h"
+#include "dawg.h"
+#include "dict_image.h"
+#include "dict_loader.h"
+#include "dict_weights.h"
+#include "perfect_hash.h"
 
 namespace text_analysis {
 
@@ -26,10 +35,37 @@ namespace text_analysis {
 const double MIN_DOUBLE = -3.14e+100;
 const double MAX_DOUBLE = 3.14e+100;
 
+// 词典的查询结构
+enum DictLayout {
+    DICT_LAYOUT_TRIE = 0,  // 双数组trie, 查询最快
+    DICT_LAYOUT_DAWG = 1,  // 合并相同后缀的最小自动机, 内存更小, 每次转移需要二分查找
+};
+
+// 词典的内存与结构统计, 用户词典只统计叠加部分
+struct DictStats {
+    DictLayout layout = DICT_LAYOUT_TRIE;
+    // 是否为镜像加载(mmap)
+    bool mapped = false;
+    bool overlay = false;
+    size_t word_count = 0;
+    size_t max_word_length = 0;
+    // 各部分占用的字节数
+    size_t unit_bytes = 0;
+    size_t key_bytes = 0;
+    size_t hash_bytes = 0;
+    DictWeightType weight_type = DICT_WEIGHT_DOUBLE;
+    size_t weight_bytes = 0;
+    // 查询结构(trie/DAWG)的节点数、字节数与分叉数直方图
+    NodeStats nodes;
+    // 与memoryUsage一致, 镜像加载时为映射大小
+    size_t total_bytes = 0;
+    double min_weight = 0.0;
+    double max_weight = 0.0;
+}; // struct DictStats
+
 class DictTrie {
 
 public:
-    // 暂不支持用户自定义词典
     DictTrie() {
     }
     ~DictTrie() {
@@ -39,82 +75,247 @@ public:
 
     DictTrie(const std::string& dict_path);
 
-    bool init(const std::string& dict_path);
+    bool init(const std::string& dict_path, DictLayout layout = DICT_LAYOUT_TRIE);
     bool initStopWords(const std::string& stop_words_path);
+    // 加载dict_compiler生成的二进制镜像, 只读mmap, 多进程共享page cache
+    // verify_sections 为true时校验全部数据(读入每一页), 默认只校验header与section表
+    bool initImage(const std::string& image_path, bool verify_sections = false);
+    // 用户词典, 叠加在共享的基础词典之上, 只为用户词构建trie(基础词典可以是DAWG)
+    // 词频按基础词典的freq_sum计算weight, 与基础词典重复的词以用户词典为准
+    bool initUserDict(std::shared_ptr<const DictTrie> base, const std::string& user_dict_path);
+    // 构建好的词典写为二进制镜像, 用户词典不支持
+    bool saveImage(const std::string& image_path) const;
+    // 浮点权重四舍五入为定点权重并替换浮点权重, 误差不超过半个最小单位, 之后不能再转换
+    // 有权重超出定点范围时保持浮点权重并返回false; 镜像加载的词典不支持, 需要在编译镜像时指定
+    bool quantizeWeights(DictWeightType type);
 
     const DictUnit* find(RuneStringArray::const_iterator begin,
             RuneStringArray::const_iterator end) const {
-        return trie_->find(begin, end);
+        if (dawg_) {
+            return dawg_->find(begin, end);
+        }
+        const DictUnit* unit = trie_->find(begin, end);
+        if (unit == NULL && base_) {
+            return base_->find(begin, end);
+        }
+        return unit;
     }
 
     void find(RuneStringArray::const_iterator begin,
             RuneStringArray::const_iterator end, 
-            std::vector<struct Dag>&res,
+            Lattice& lattice,
             size_t max_word_len = MAX_WORD_LENGTH) const {
-        trie_->find(begin, end, res, max_word_len);
+        if (base_) {
+            base_->find(begin, end, lattice, max_word_len);
+            trie_->merge(begin, end, lattice, max_word_len);
+            return;
+        }
+        if (dawg_) {
+            dawg_->find(begin, end, lattice, max_word_len);
+            return;
+        }
+        trie_->find(begin, end, lattice, max_word_len);
+    }
+    // 以begin开头的全部词, 按词尾升序回调 visit(k, unit), 结果与find中该位置的边一致
+    // 调用方用end限制最大词长
+    template <class Visit>
+    void findPrefixes(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            Visit visit) const {
+        if (base_) {
+            findOverlayPrefixes(begin, end, visit);
+            return;
+        }
+        findOwnPrefixes(begin, end, visit);
     }
 
-    bool find(std::string& word) const {
-        const DictUnit *tmp = NULL;
-        RuneStringArray runes;
-        if (!decodeRunesInString(word, runes)) {
-            // add log
-            return false;
+    // 精确查词, 通过完美哈希直接查utf8字节, 命中后与词的rune逐个比较确认, 不分配内存
+    // DAWG布局沿自动机逐字符匹配
+    const DictUnit* findWord(const char* word, size_t len) const {
+        if (dawg_) {
+            return dawg_->findWord(word, len);
         }
-        tmp = find(runes.begin(), runes.end());
-        if (tmp == NULL) {
-            return false;
-        } else {
-            return true;
+        int32_t index = word_index_.find(word, len);
+        if (index >= 0 && sameWord(units_[index], word, len)) {
+            return &units_[index];
         }
+        return base_ ? base_->findWord(word, len) : NULL;
     }
+    const DictUnit* findWord(const std::string& word) const {
+        return findWord(word.data(), word.size());
+    }
+
+    bool find(const std::string& word) const {
+        return findWord(word) != NULL;
+    }
+
+    // 本词典的全部词(用户词典不包含基础词典的词), DAWG布局按字典序排列且没有重复的词
+    const PodArray<DictUnit>& getUnits() const {
+        return units_;
+    }
+    // unit需要属于本词典(用户词典不包含基础词典的词)
+    // DAWG布局不保存词的rune, 由unit的下标(排名)沿自动机还原
+    void getWordRunes(const DictUnit& unit, std::vector<Rune>& word) const;
 
     double getMinWeight() const {
         return min_weight_;
     }
+    // 词的log权重, 定点权重换算为浮点; unit为NULL(未登录字)时为getMinWeight()
+    // unit需要属于本词典或基础词典, 用户词典中基础词典的词取基础词典的权重
+    double getWeight(const DictUnit* unit) const {
+        if (unit == NULL) {
+            return min_weight_;
+        }
+        if (base_ && !ownsUnit(unit)) {
+            return base_->getWeight(unit);
+        }
+        return weights_->get(unit - units_.data());
+    }
+
+    DictWeightType weightType() const {
+        return weights_->type();
+    }
+    // 用户词典的基础词典, 其余为NULL
+    const DictTrie* getBase() const {
+        return base_.get();
+    }
+    // 权重表, 下标与getUnits()一致; T与weightType()不一致时为NULL
+    // 用户词典只包含自身的词, 基础词典的词从getBase()取(两者类型相同)
+    template <typename T>
+    const WeightTable<T>* getWeightTable() const {
+        if (weights_->type() != WeightTraits<T>::TYPE) {
+            return NULL;
+        }
+        return static_cast<const WeightTable<T>*>(weights_.get());
+    }
+
+    // 词典占用的内存(镜像加载时为映射大小), 用户词典不包含基础词典
+    size_t memoryUsage() const {
+        if (image_) {
+            return image_->size();
+        }
+        return units_.bytes() + runes_.bytes() + word_index_.memoryUsage()
+            + weights_->bytes()
+            + (trie_ == NULL ? 0 : trie_->memoryUsage())
+            + (dawg_ ? dawg_->memoryUsage() : 0);
+    }
+    // 需要遍历查询结构, 用于离线分析与容量评估
+    void getStats(DictStats& stats) const;
+    DictLayout layout() const {
+        return dawg_ ? DICT_LAYOUT_DAWG : DICT_LAYOUT_TRIE;
+    }
+    // 最近一次加载中格式错误的行
+    const std::vector<DictLoadError>& loadErrors() const {
+        return load_errors_;
+    }
 private:
-    void createTrie(const std::vector<DictUnit>& dictUnits);
-    // word freq
-    bool makeNodeInfo(DictUnit& node_info,
-            const std::string& word,
-            double weight);
-    bool makeNodeInfo(DictUnit& node_info,
-            const std::vector<std::string>& runes,
-            double weight);
+    // 词的rune, 只有trie布局可用; DAWG布局不保存rune且offset为0, 需要通过getWordRunes还原
+    const Rune* unitRunes(const DictUnit& unit) const {
+        assert(!dawg_);
+        return runes_.data() + unit.offset;
+    }
+    // unit的rune与utf8字节[word, word + len)解码后完全相同
+    bool sameWord(const DictUnit& unit, const char* word, size_t len) const;
+    // 只查本词典的trie/DAWG; 基础词典不会再叠加, 避免模板递归实例化
+    template <class Visit>
+    void findOwnPrefixes(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            Visit& visit) const {
+        if (dawg_) {
+            dawg_->findPrefixes(begin, end, visit);
+            return;
+        }
+        trie_->findPrefixes(begin, end, visit);
+    }
+    // 用户词典: 先取本trie的词, 再与基础词典的结果按词尾归并, 同一词尾以用户词为准
+    template <class Visit>
+    void findOverlayPrefixes(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            Visit& visit) const {
+        LatticeEdge words[MAX_WORD_LENGTH];
+        size_t count = 0;
+        trie_->findPrefixes(begin, end, [&words, &count](size_t k, const DictUnit* unit) {
+            if (unit != NULL && count < MAX_WORD_LENGTH) {
+                words[count].unit = unit;
+                words[count].end = k;
+                count++;
+            }
+        });
+        size_t w = 0;
+        auto merge = [&](size_t k, const DictUnit* unit) {
+            for (; w < count && words[w].end < k; w++) {
+                visit(words[w].end, words[w].unit);
+            }
+            if (w < count && words[w].end == k) {
+                visit(k, words[w].unit);
+                w++;
+                return;
+            }
+            visit(k, unit);
+        };
+        base_->findOwnPrefixes(begin, end, merge);
+        for (; w < count; w++) {
+            visit(words[w].end, words[w].unit);
+        }
+    }
+    bool ownsUnit(const DictUnit* unit) const {
+        std::less<const DictUnit*> less;
+        return !less(unit, units_.begin()) && less(unit, units_.end());
+    }
+    bool createTrie(DictLayout layout = DICT_LAYOUT_TRIE);
+    bool createWordIndex();
 
     bool loadDict(const std::string& filePath);
     bool loadStopWordsDict(const std::string& filePath);
+    void reportErrors(const std::string& file_path, const std::vector<DictLoadError>& errors);
 
     void setDefaultWordWeights();
+    // 镜像中每个词的rune区间都在runes_内(trie布局)
+    bool checkUnits() const;
+    // 镜像中的权重按类型三选一, 个数与units_一致
+    bool loadWeights(const DictImage& image);
+    template <typename T>
+    bool loadWeightTable(const DictImage& image);
+    template <typename T>
+    bool quantizeWeightTable();
 
-    static bool weightCompare(const DictUnit& lhs, const DictUnit& rhs) {
-        return lhs.weight < rhs.weight;
-    }
-    
     // 计算freq, 考虑后续支持jieba等中文/泰文分词
-    double calcFreqSum(const std::vector<DictUnit>& node_infos) const {
+    double calcFreqSum(const std::vector<double>& freqs) const {
         double sum = 0.0;
-        for (size_t i = 0; i < node_infos.size(); i++) {
-            sum += node_infos[i].weight;
+        for (size_t i = 0; i < freqs.size(); i++) {
+            sum += freqs[i];
         }
         return sum;
     }
     // 预留weights
-    void calculateWeight(std::vector<DictUnit>& node_infos, double sum) const {
+    void calculateWeight(std::vector<double>& weights, double sum) const {
         // assert(sum > 0.0);
-        for (size_t i = 0; i < node_infos.size(); i++) {
-            DictUnit& node_info = node_infos[i];
-            // assert(node_info.weight > 0.0);
-            node_info.weight = log(double(node_info.weight)/sum);
+        for (size_t i = 0; i < weights.size(); i++) {
+            // assert(weights[i] > 0.0);
+            weights[i] = log(weights[i]/sum);
         }
     }
-    
-    void shrink(std::vector<DictUnit>& units) const {
-        std::vector<DictUnit>(units.begin(), units.end()).swap(units);
-    }
 private:
+    // 构建期数据, 构建trie时转移到units_/runes_/weights_
     std::vector<DictUnit> node_infos_;
+    std::vector<Rune> word_runes_;
+    std::vector<double> word_weights_;
+    std::vector<DictLoadError> load_errors_;
+
+    PodArray<DictUnit> units_;
+    // 全部词的rune连续存放, DictUnit通过offset/length引用; DAWG布局为空
+    PodArray<Rune> runes_;
+    // 按layout二选一, 另一个为空
     Trie * trie_ = NULL;
+    std::unique_ptr<Dawg> dawg_;
+    // 词的utf8 => units_下标, DAWG布局为空
+    PerfectHash word_index_;
+    // 权重, 与units_一一对应, 类型在构建/加载时确定, 不为NULL
+    std::unique_ptr<DictWeights> weights_ = std::make_unique<WeightTable<double> >();
+    // 镜像加载时持有映射内存
+    std::unique_ptr<DictImage> image_;
+    // 用户词典的基础词典
+    std::shared_ptr<const DictTrie> base_;
     double freq_sum_ = 0.0;
     double min_weight_ = 0.0;
     double max_weight_ = 0.0;
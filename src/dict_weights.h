@@ -0,0 +1,165 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dict_weights.h 
+ *    Description:  词典的log权重, 浮点或定点, 每个词典只保存一种 
+ * 
+ *        Created:  2022/04/07 10:05:41
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_DICT_WEIGHTS_H
+#define TEXT_ANALYSIS_DICT_WEIGHTS_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "pod_array.h"
+#include "dict_image.h"
+
+namespace text_analysis {
+
+// 权重的存储方式, 每个词典只保存其中一种, 定点时MP分词使用整数DP
+enum DictWeightType {
+    DICT_WEIGHT_DOUBLE = 0,
+    DICT_WEIGHT_FIXED16 = 1,  // Q5.10, 范围 [-32, 32)
+    DICT_WEIGHT_FIXED32 = 2,  // Q11.20, 范围 [-2048, 2048)
+};
+
+const int FIXED16_FRAC_BITS = 10;
+const int FIXED32_FRAC_BITS = 20;
+
+// 权重的元素类型 => 权重类型、镜像section以及与浮点的换算
+template <typename T>
+struct WeightTraits;
+
+template <>
+struct WeightTraits<double> {
+    static const DictWeightType TYPE = DICT_WEIGHT_DOUBLE;
+    static const uint32_t SECTION = SECTION_WEIGHTS;
+    static double toDouble(double value) {
+        return value;
+    }
+    static double fromDouble(double weight, bool& /*clamped*/) {
+        return weight;
+    }
+};
+
+// 四舍五入, 超出T的范围时截断并置clamped
+template <typename T, int FracBits, DictWeightType Type, uint32_t Section>
+struct FixedWeightTraits {
+    static const DictWeightType TYPE = Type;
+    static const uint32_t SECTION = Section;
+    static double toDouble(T value) {
+        return std::ldexp(double(value), -FracBits);
+    }
+    static T fromDouble(double weight, bool& clamped) {
+        double value = std::round(std::ldexp(weight, FracBits));
+        const double lo = std::numeric_limits<T>::min();
+        const double hi = std::numeric_limits<T>::max();
+        clamped = clamped || value < lo || value > hi;
+        return T(std::min(std::max(value, lo), hi));
+    }
+};
+
+template <>
+struct WeightTraits<int16_t>
+    : FixedWeightTraits<int16_t, FIXED16_FRAC_BITS, DICT_WEIGHT_FIXED16, SECTION_FIXED_WEIGHTS16> {
+};
+
+template <>
+struct WeightTraits<int32_t>
+    : FixedWeightTraits<int32_t, FIXED32_FRAC_BITS, DICT_WEIGHT_FIXED32, SECTION_FIXED_WEIGHTS32> {
+};
+
+// 类型在构建/加载时确定一次, 之后通过DictWeights按下标取浮点权重,
+// MP分词按type()取得具体的WeightTable<T>, 内层循环直接访问数组
+class DictWeights {
+public:
+    virtual ~DictWeights() {
+    }
+    virtual DictWeightType type() const = 0;
+    // 第i个词的log权重, 定点换算为浮点
+    virtual double get(size_t i) const = 0;
+    virtual size_t size() const = 0;
+    virtual size_t bytes() const = 0;
+    virtual void save(DictImageWriter& writer) const = 0;
+}; // class DictWeights
+
+template <typename T>
+class WeightTable : public DictWeights {
+public:
+    WeightTable(): min_weight_(0) {
+    }
+    ~WeightTable() {
+    }
+
+    DictWeightType type() const {
+        return WeightTraits<T>::TYPE;
+    }
+    double get(size_t i) const {
+        return WeightTraits<T>::toDouble(values_[i]);
+    }
+    size_t size() const {
+        return values_.size();
+    }
+    size_t bytes() const {
+        return values_.bytes();
+    }
+    void save(DictImageWriter& writer) const {
+        writer.addSection(WeightTraits<T>::SECTION, values_);
+    }
+
+    const T* data() const {
+        return values_.data();
+    }
+    // 未登录字的权重, 与数组同样量化
+    T minWeight() const {
+        return min_weight_;
+    }
+
+    // 接管浮点权重, 只用于T为double
+    void assign(std::vector<T>& values, T min_weight) {
+        values_.assign(values);
+        min_weight_ = min_weight;
+    }
+    // 由浮点权重量化, 有超出范围的值时返回false且不修改
+    bool quantize(const WeightTable<double>& weights, double min_weight) {
+        bool clamped = false;
+        std::vector<T> values(weights.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            values[i] = WeightTraits<T>::fromDouble(weights.data()[i], clamped);
+        }
+        const T quantized_min = WeightTraits<T>::fromDouble(min_weight, clamped);
+        if (clamped) {
+            return false;
+        }
+        values_.assign(values);
+        min_weight_ = quantized_min;
+        return true;
+    }
+    // 指向镜像中的数组, 镜像没有该类型的section时返回false
+    bool load(const DictImage& image, double min_weight) {
+        bool clamped = false;
+        const T quantized_min = WeightTraits<T>::fromDouble(min_weight, clamped);
+        if (clamped || !image.getSection(WeightTraits<T>::SECTION, values_)) {
+            return false;
+        }
+        min_weight_ = quantized_min;
+        return true;
+    }
+private:
+    PodArray<T> values_;
+    T min_weight_;
+}; // class WeightTable
+
+}
+
+#endif  // TEXT_ANALYSIS_DICT_WEIGHTS_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,35 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  logger.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/04/06 11:20:21
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include "logger.h"
+
+namespace text_analysis {
+
+namespace {
+
+LogHandler g_log_handler;
+
+}
+
+void setLogHandler(const LogHandler& handler) {
+    g_log_handler = handler;
+}
+
+void logMessage(const std::string& message) {
+    if (g_log_handler) {
+        g_log_handler(message);
+    }
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,33 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  logger.h 
+ *    Description:  日志回调, 库内不直接输出到stdout/stderr 
+ * 
+ *        Created:  2022/04/06 11:20:15
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_LOGGER_H
+#define TEXT_ANALYSIS_LOGGER_H
+
+#include <functional>
+#include <string>
+
+namespace text_analysis {
+
+// 词典加载失败等不会通过返回值逐条带回的消息, 默认丢弃
+// 可能在加载线程中调用, 回调需要线程安全
+typedef std::function<void(const std::string&)> LogHandler;
+
+// 需要在加载词典之前设置, 不能与加载并发调用; 传空的handler恢复为丢弃
+void setLogHandler(const LogHandler& handler);
+void logMessage(const std::string& message);
+
+}
+
+#endif  // TEXT_ANALYSIS_LOGGER_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
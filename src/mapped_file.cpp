@@ -0,0 +1,60 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  mapped_file.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/14 10:42:15
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+
+namespace text_analysis {
+
+bool MappedFile::open(const std::string& path, bool sequential) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    if (sequential) {
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    }
+    data_ = static_cast<const char*>(addr);
+    size_ = st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_ != NULL) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = NULL;
+    size_ = 0;
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,52 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  mapped_file.h 
+ *    Description:  只读mmap文件 
+ * 
+ *        Created:  2022/03/14 10:42:08
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_MAPPED_FILE_H
+#define TEXT_ANALYSIS_MAPPED_FILE_H
+
+#include <stddef.h>
+#include <string>
+
+namespace text_analysis {
+
+class MappedFile {
+public:
+    MappedFile() {
+    }
+    ~MappedFile() {
+        close();
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // MAP_SHARED: 多个进程共享page cache中的同一份数据
+    // sequential 为true时提示内核顺序预读
+    bool open(const std::string& path, bool sequential = false);
+    void close();
+
+    // 空文件返回NULL
+    const char* data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+private:
+    const char* data_ = NULL;
+    size_t size_ = 0;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_MAPPED_FILE_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -9,11 +9,12 @@
 
 #include "separator_iterator.h"
 #include "nlp_stringutil.h"
+#include "dict_manager.h"
 #include "mm_segment.h"
 
 namespace text_analysis {
 
-extern std::unordered_map<std::string, std::unique_ptr<DictTrie> > g_dict_tries;
+extern DictManager g_dict_manager;
 
 MMSegment::MMSegment(const Normalizer* normalizer) {
     normalizer_ = normalizer;
@@ -30,210 +31,257 @@ void MMSegment::cut(const std::string& text, std::vector<std::string>& res) cons
 
 // default cut: normalizer + bmm
 void MMSegment::cut(const std::string& text, const std::string& country, std::vector<std::string>& res) const {
+    SegmentContext ctx;
+    cut(text, country, ctx, res);
+}
+
+void MMSegment::cut(const std::string& text,
+        const std::string& country,
+        std::vector<TokenSpan>& spans) const {
+    SegmentContext ctx;
+    cut(text, country, ctx, spans);
+}
+
+void MMSegment::cut(const std::string& text,
+        const std::string& country,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
+    // 持有词典直到分词结束, 期间被淘汰也不会析构
+    cut(text, g_dict_manager.resolve(country), ctx, res);
+}
+
+void MMSegment::cut(const std::string& text,
+        const std::string& country,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    cut(text, g_dict_manager.resolve(country), ctx, spans);
+}
+
+void MMSegment::cut(const std::string& text,
+        const CountryHandle& handle,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
     // lower
-    std::string lower_text(text);
-    StringUtil::toLowerCase(lower_text);
-    // 默认分词, 保持一致
-    if (g_dict_tries.find(country) == g_dict_tries.end()) {
-        cut(lower_text, res);
+    ctx.lower_text.assign(text);
+    StringUtil::toLowerCase(ctx.lower_text);
+    if (!cut(handle, ctx)) {
+        cut(ctx.lower_text, res);
         return;
     }
-    res.clear();
-    std::vector<WordRange> word_ranges;
-    std::vector<Word> words;
-    RuneStringArray runes;
+    getStringsFromWordRanges(ctx.lower_text, ctx.word_ranges, res);
+}
 
-    if (!decodeRunesInString(lower_text, runes)) {
-        // TODO(philister): add log
-        cut(lower_text, res);
+void MMSegment::cut(const std::string& text,
+        const CountryHandle& handle,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    ctx.lower_text.assign(text);
+    StringUtil::toLowerCase(ctx.lower_text);
+    if (!cut(handle, ctx)) {
+        spans.assign(1, getSpanOfString(text));
         return;
     }
-    if (runes.empty()) {
-        return;
+    getSpansFromWordRanges(ctx.word_ranges, spans);
+}
+
+// 词典不存在或者解码失败时返回false, 整个text作为一个词
+bool MMSegment::cut(const CountryHandle& handle, SegmentContext& ctx) const {
+    ctx.word_ranges.clear();
+    // 先解码, 没有词典时decode_error同样有效
+    // 非法输入不在这里打日志(调用频繁), 位置留在ctx.decode_error, 由传入ctx的调用方读取
+    if (!decodeRunesInString(ctx.lower_text, ctx.runes, ctx.decode_error)) {
+        return false;
+    }
+    // 默认分词, 保持一致
+    if (!handle.valid()) {
+        return false;
+    }
+    if (ctx.runes.empty()) {
+        return true;
     }
     if (normalizer_ != NULL) {
-        normalizer_->normalize(runes, word_ranges);
-        cut(lower_text, country, word_ranges, words, MAX_WORD_LENGTH, BMM);
+        normalizer_->normalize(ctx);
+        const std::vector<WordRange>& ranges = ctx.norm_ranges;
+        // 大文本分片并发, 每个分片写入各自的shard_ctx
+        bool sharded = cutShards(ctx, [&](SegmentContext& shard_ctx, size_t begin, size_t end) {
+            cut(handle, ranges.begin() + begin, ranges.begin() + end,
+                    shard_ctx, MAX_WORD_LENGTH, BMM);
+        });
+        if (!sharded) {
+            cut(handle, ranges.begin(), ranges.end(), ctx, MAX_WORD_LENGTH, BMM);
+        }
     } else {
-        cut(lower_text, country, words, MAX_WORD_LENGTH, BMM);
+        cut(handle.dict(), ctx, MAX_WORD_LENGTH, BMM);
     }
-    getStringsFromWords(words, res);
+    return true;
 }
 
-void MMSegment::cut(const std::string& text,
-        const std::string& country,
-        std::vector<std::string>& res,
-        size_t max_word_len,
-        MMType seg_mode) const {
-    std::vector<Word> words;
-    cut(text, country, words, max_word_len, seg_mode);
-    // words(uint32) => string(char*)
-    getStringsFromWords(words, res);
+bool MMSegment::cutNormalized(const CountryHandle& handle,
+        SegmentContext& ctx,
+        size_t range_begin,
+        size_t range_end) const {
+    if (!handle.valid()) {
+        return false;
+    }
+    cut(handle, ctx.norm_ranges.begin() + range_begin, ctx.norm_ranges.begin() + range_end,
+            ctx, MAX_WORD_LENGTH, BMM);
+    return true;
 }
 
 // 默认segment
-void MMSegment::cut(const std::string& text,
-        const std::string& country,
-        std::vector<Word>& words, 
+void MMSegment::cut(const DictTrie* dict_trie,
+        SegmentContext& ctx,
         size_t max_word_len,
         MMType seg_mode) const {
     // 默认这里已经做过normalize
     // 直接切分即可
-    SeparatorIter siter(symbols_, text);
+    SeparatorIter siter(symbols_, symbol_scanner_, ctx.lower_text, ctx.runes);
     WordRange range;
-    std::vector<WordRange> word_ranges;
-    word_ranges.reserve(text.size());
     // 先分句 再分词, 不考虑合并的问题
     while (siter.hasNext()) {
         range = siter.next();
-        cut(country, range.left, range.right+1, word_ranges, max_word_len, seg_mode);
+        cut(dict_trie, range.left, range.right+1, ctx, max_word_len, seg_mode);
     }
-    words.clear();
-    words.reserve(word_ranges.size());
-    getWordsFromWordRanges(text, word_ranges, words);
 }
 
 // word_ranges, 在原数据上切分减少开销
-void MMSegment::cut(const std::string& text,
-        const std::string& country,
-        const std::vector<WordRange>& word_ranges, 
-        std::vector<Word>& words, 
+void MMSegment::cut(const CountryHandle& handle,
+        std::vector<WordRange>::const_iterator range_begin,
+        std::vector<WordRange>::const_iterator range_end,
+        SegmentContext& ctx,
         size_t max_word_len,
         MMType seg_mode) const {
+    const DictTrie* dict_trie = handle.dict();
+    const bool ascii_only = handle.asciiOnly();
     // 再次切分, 先分块再分词
-    std::vector<WordRange> new_word_ranges;
-    for (std::vector<WordRange>::const_iterator it = word_ranges.begin();
-            it != word_ranges.end(); it++) {
+    for (std::vector<WordRange>::const_iterator it = range_begin; it != range_end; it++) {
         // id地区 非ascii 不处理
-        if (country == "id" && !it->isAllAscii()) {
-            new_word_ranges.push_back(*it);
+        if (ascii_only && !it->isAllAscii()) {
+            ctx.word_ranges.push_back(*it);
             continue;
         }
         // default模式下, 数字不处理
         if (it->isALLUnicodeDigit()) {
-            new_word_ranges.push_back(*it);
+            ctx.word_ranges.push_back(*it);
             continue;
         }
-        cut(country, it->left, it->right+1, new_word_ranges, max_word_len, seg_mode);
+        cut(dict_trie, it->left, it->right+1, ctx, max_word_len, seg_mode);
     }
-    words.clear();
-    words.reserve(new_word_ranges.size());
-    getWordsFromWordRanges(text, new_word_ranges, words);
 }
 
-void MMSegment::cut(const std::string& country,
+void MMSegment::cut(const DictTrie* dict_trie,
         RuneStringArray::const_iterator begin,
         RuneStringArray::const_iterator end,
-        std::vector<WordRange>& word_ranges,
+        SegmentContext& ctx,
         size_t max_word_len,
         MMType seg_mode) const {
-    // 获取当前输入text的DAG
-    std::vector<Dag> dags;
-    const DictTrie* dict_trie = g_dict_tries.at(country).get();
-    dict_trie->find(begin, end, dags, max_word_len);
+    // 获取当前输入text的词图, MM不需要权重
+    dict_trie->find(begin, end, ctx.lattice, max_word_len);
+    cutLattice(begin, end, ctx, seg_mode, ctx.word_ranges);
+}
+
+void MMSegment::cutLattice(RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        SegmentContext& ctx,
+        std::vector<WordRange>& words) const {
+    cutLattice(begin, end, ctx, BMM, words);
+}
+
+void MMSegment::cutLattice(RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        SegmentContext& ctx,
+        MMType seg_mode,
+        std::vector<WordRange>& words) const {
+    Lattice& lattice = ctx.lattice;
     bool need_seg = true;
     switch (seg_mode) {
         case MM:
-            need_seg = calcMM(dags);
+            need_seg = calcMM(lattice);
             break;
         case RMM:
-            need_seg = calcRMM(dags);
+            need_seg = calcRMM(lattice);
             break;
         case BMM:
-            need_seg = calcBMM(dags);
+            need_seg = calcBMM(lattice, ctx.positions);
             break;
         default:
-            need_seg = calcMM(dags);
+            need_seg = calcMM(lattice);
             break;
     }
-    cutByDag(begin, end, dags, word_ranges, need_seg);
+    cutByDag(begin, end, lattice, words, need_seg);
 }
 
-const DictTrie* MMSegment::getDictTrie(const std::string& country) const {
-    if (g_dict_tries.find(country) == g_dict_tries.end()) {
-        return NULL;
-    }
-    return g_dict_tries.at(country).get();
+std::shared_ptr<const DictTrie> MMSegment::getDictTrie(const std::string& country) const {
+    return g_dict_manager.get(country);
 }
 
-bool MMSegment::calcMM(std::vector<Dag>& dags) const {
+bool MMSegment::calcMM(Lattice& lattice) const {
     // route[idx] = DAG[idx][-1]
-    for (std::vector<Dag>::iterator it = dags.begin(); it != dags.end(); it++) {
-        // basic MM 暂时不需要weight 规则
-        it->p_info = NULL;
-        // 不生效
-        it->weight = 0.0; 
-        // assert(!it->nexts.empty());
-        if (it->nexts.empty()) {
+    lattice.routes.resize(lattice.size());
+    for (size_t i = 0; i < lattice.size(); i++) {
+        // assert(lattice.edgeBegin(i) != lattice.edgeEnd(i));
+        if (lattice.edgeBegin(i) == lattice.edgeEnd(i)) {
             return false;
         }
         // 直接取最后一个item
-        it->next_pos = it->nexts.back().first;
-        it->p_info = it->nexts.back().second;
+        lattice.routes[i] = (lattice.edgeEnd(i) - 1)->end;
     }
     return true;
 }
 
-// TODO(philister): 循环多次, 考虑优化
-bool MMSegment::calcRMM(std::vector<Dag>& dags) const {
+// 每个位置先取最长的词, 再从词尾向前检查: 词内的后续位置j如果有更长的路径(routes[j]超出当前词尾),
+// 当前词缩短到j之前, 直到不再与后面的词冲突
+// 只有 j <= routes[i] 时才会缩短, 所以只需要检查当前词内的位置, 每个位置最多 max_word_len 次比较
+bool MMSegment::calcRMM(Lattice& lattice) const {
     // [(0, [0, 1, 2, 3, 4]), (1, NULL), (4, [4, 5, 6, 7, 8, 9]), (9, [9])]
-    size_t length = dags.size();
-    size_t i = length - 1;
-    for (std::vector<Dag>::reverse_iterator rit = dags.rbegin(); rit != dags.rend(); rit++) {
-        i = dags.rend() - rit - 1;
-        // 置空
-        rit->p_info = NULL;
-        rit->weight = 0.0;
-        // assert(!rit->nexts.empty());
-        if (rit->nexts.empty()) {
+    const size_t length = lattice.size();
+    std::vector<uint32_t>& routes = lattice.routes;
+    routes.resize(length);
+    for (size_t i = length; i-- > 0;) {
+        // assert(lattice.edgeBegin(i) != lattice.edgeEnd(i));
+        if (lattice.edgeBegin(i) == lattice.edgeEnd(i)) {
             return false;
         }
         // 0-4 1-0 4-9 5-7 6-9 8-8 9-9
-        rit->next_pos = rit->nexts.back().first;
-        rit->p_info = rit->nexts.back().second;
+        const LatticeEdge* e = lattice.edgeEnd(i) - 1;
+        routes[i] = e->end;
         // 指向自己不用调整
-        if (rit == dags.rbegin() || rit->next_pos == i) {
+        if (i == length - 1 || routes[i] == i) {
             continue;
         }
-        
-        // 向后遍历
-        // [length-1, i)
-        for (size_t j = length-1; j > i; --j) {
-            // std::cout << "j: " << j << "-" << dags[j].next_pos << std::endl;
-            if (dags[i].next_pos >= j && dags[i].next_pos < dags[j].next_pos) {
+
+        // 向前遍历当前词内的位置 [routes[i], i)
+        // routes[i]只减不增, 候选边也只需要向前移动
+        for (size_t j = routes[i]; j > i; --j) {
+            if (routes[i] >= j && routes[i] < routes[j]) {
                 // 0-(3,3) 1-(1, null) 4-(9, 9) 9-(9,9)
-                for (std::vector<std::pair<size_t, const DictUnit*> >::const_reverse_iterator nrit = dags[i].nexts.rbegin();
-                        nrit != dags[i].nexts.rend(); nrit++) {
-                    // 合法的词典一定会找到该index
-                    if (nrit->first < j) {
-                        dags[i].next_pos = nrit->first;
-                        dags[i].p_info = nrit->second;
-                        break;
-                    }
+                // 首字一定满足 end < j
+                while (e->end >= j) {
+                    --e;
                 }
+                routes[i] = e->end;
             }
         }
     }
     return true;
 }
 
-bool MMSegment::calcBMM(std::vector<Dag>& dags) const {
-    calcMM(dags);
-    // 记录mm index/pos_info
-    std::vector<size_t> pos_index;
-    size_t item_num = dags.size();
-    for (const auto& dag : dags) {
-        pos_index.push_back(dag.next_pos);
+bool MMSegment::calcBMM(Lattice& lattice, std::vector<size_t>& pos_index) const {
+    // 记录mm index
+    pos_index.resize(lattice.size());
+    for (size_t i = 0; i < lattice.size(); i++) {
+        if (lattice.edgeBegin(i) == lattice.edgeEnd(i)) {
+            return false;
+        }
+        pos_index[i] = (lattice.edgeEnd(i) - 1)->end;
     }
+    size_t item_num = pos_index.size();
 
-    // 继续计算RMM
-    calcRMM(dags);
-    if (dags.size() != item_num) {
-        return false;
-    }
+    // 继续计算RMM, 两者在MM的路径上一致才切分
+    calcRMM(lattice);
     size_t i = 0;
     while (i < item_num) {
-        if (dags[i].next_pos != pos_index[i]) { 
+        if (lattice.routes[i] != pos_index[i]) { 
             return false;
         }
         i = pos_index[i] + 1;
@@ -244,7 +292,7 @@ bool MMSegment::calcBMM(std::vector<Dag>& dags) const {
 // TODO(philister): 取消cppjieba中的wordrange逻辑, 直接遍历
 void MMSegment::cutByDag(RuneStringArray::const_iterator begin, 
         RuneStringArray::const_iterator end,
-        const std::vector<Dag>& dags, 
+        const Lattice& lattice, 
         std::vector<WordRange>& words,
         bool need_seg) const {
 
@@ -254,19 +302,12 @@ void MMSegment::cutByDag(RuneStringArray::const_iterator begin,
         return;
     }
     size_t i = 0;
-    while (i < dags.size()) {
-        const DictUnit* p_word = dags[i].p_info;
-        if (p_word != NULL) {
-            // assert(p_word->word.size() >= 1);
-            WordRange wr(begin + i, begin + i + p_word->word.size() - 1);
-            words.push_back(wr);
-            i += p_word->word.size();
-        } else {
-             // single word 未登录词单独切分
-             WordRange wr(begin + i, begin + i);
-             words.push_back(wr);
-            i++;
-        }
+    while (i < size_t(end - begin)) {
+        // 未登录词单独切分, route为自身
+        size_t last = lattice.routes[i];
+        WordRange wr(begin + i, begin + last);
+        words.push_back(wr);
+        i = last + 1;
     }
 }
 
@@ -10,7 +10,9 @@
 
 #include "segment_base.h"
 #include "dict_trie.h"
+#include "dict_manager.h"
 #include "normalizer.h"
+#include "segment_context.h"
 
 namespace text_analysis {
 
@@ -18,9 +20,43 @@ class MMSegment : SegmentBase {
 public:
     MMSegment(const Normalizer* normalizer);
     ~MMSegment();
+    using SegmentBase::setShardExecutor;
 
     void cut(const std::string& text, std::vector<std::string>& res) const;
     void cut(const std::string& text, const std::string& country, std::vector<std::string>& res) const;
+    // 只返回每个词在text中的位置, 不复制字符串
+    void cut(const std::string& text, const std::string& country, std::vector<TokenSpan>& spans) const;
+    // 复用ctx中的缓冲区, 预热后不再分配内存(字符串结果除外)
+    void cut(const std::string& text,
+            const std::string& country,
+            SegmentContext& ctx,
+            std::vector<std::string>& res) const;
+    void cut(const std::string& text,
+            const std::string& country,
+            SegmentContext& ctx,
+            std::vector<TokenSpan>& spans) const;
+    // 已解析的地区, 分词过程不再查找词典
+    void cut(const std::string& text,
+            const CountryHandle& handle,
+            SegmentContext& ctx,
+            std::vector<std::string>& res) const;
+    void cut(const std::string& text,
+            const CountryHandle& handle,
+            SegmentContext& ctx,
+            std::vector<TokenSpan>& spans) const;
+    // 流式分词: ctx.norm_ranges[range_begin, range_end)为已归一化的结果, 分词结果追加到ctx.word_ranges
+    // handle无效时返回false
+    bool cutNormalized(const CountryHandle& handle,
+            SegmentContext& ctx,
+            size_t range_begin,
+            size_t range_end) const;
+
+    // 在已生成的词图ctx.lattice上做BMM分词(与MP共用词图), 词图为DictTrie::find对[begin, end)的结果
+    // 只改写词图的路径数组, 结果追加到words
+    void cutLattice(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            SegmentContext& ctx,
+            std::vector<WordRange>& words) const;
 
     // default 分词, 不做归一化
     // void cutMM(const std::string& text, const std::string& country, std::vector<std::string>& res) const;
@@ -32,46 +68,52 @@ private:
         RMM, // 最大逆向
         BMM  // 最大双向
     };
-    void cut(const std::string& text,
-            const std::string& country,
-            std::vector<std::string>& res,
-            size_t max_word_len,
-            MMType seg_type) const;
+    // ctx.lower_text => ctx.word_ranges, 词典不存在或者解码失败时返回false
+    // 总是先解码, 可以用ctx.decode_error区分两者
+    bool cut(const CountryHandle& handle, SegmentContext& ctx) const;
 
-    void cut(const std::string& text,
-            const std::string& country,
-            std::vector<Word>& words,
+    // 未归一化时按分隔符分块
+    void cut(const DictTrie* dict_trie,
+            SegmentContext& ctx,
             size_t max_word_len,
             MMType seg_type) const;
 
-    void cut(const std::string& text,
-            const std::string& country,
-            const std::vector<WordRange>& word_ranges, 
-            std::vector<Word>& words, 
+    // 归一化结果中的 [range_begin, range_end)
+    void cut(const CountryHandle& handle,
+            std::vector<WordRange>::const_iterator range_begin,
+            std::vector<WordRange>::const_iterator range_end,
+            SegmentContext& ctx,
             size_t max_word_len,
             MMType seg_mode) const;
 
-    // 传入const_iter防止复制,修改等操作
-    void cut(const std::string& country,
+    // 传入const_iter防止复制,修改等操作, 结果追加到ctx.word_ranges
+    void cut(const DictTrie* dict_trie,
             RuneStringArray::const_iterator begin,
             RuneStringArray::const_iterator end,
-            std::vector<WordRange>& words,
+            SegmentContext& ctx,
             size_t max_word_len,
             MMType seg_type) const;
 
-    const DictTrie* getDictTrie(const std::string& country) const; 
+    void cutLattice(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            SegmentContext& ctx,
+            MMType seg_mode,
+            std::vector<WordRange>& words) const;
+
+    std::shared_ptr<const DictTrie> getDictTrie(const std::string& country) const; 
     // 核心功能
     void cutByDag(RuneStringArray::const_iterator begin, 
         RuneStringArray::const_iterator end, 
-        const std::vector<Dag>& dags, 
+        const Lattice& lattice, 
         std::vector<WordRange>& words,
         bool need_seg = false) const;
+    // 结果写入lattice.routes
     // MM
-    bool calcMM(std::vector<Dag>& dags) const;
+    bool calcMM(Lattice& lattice) const;
     // RMM
-    bool calcRMM(std::vector<Dag>& dags) const;
-    // BMM
-    bool calcBMM(std::vector<Dag>& dags) const;
+    bool calcRMM(Lattice& lattice) const;
+    // BMM, pos_index为复用的缓冲区
+    bool calcBMM(Lattice& lattice, std::vector<size_t>& pos_index) const;
 
 private:
     // 标准化
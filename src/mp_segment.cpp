@@ -10,16 +10,20 @@
  * 
  * =====================================================================================
  */
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <memory>
 
 #include "separator_iterator.h"
 #include "nlp_stringutil.h"
+#include "dict_manager.h"
 #include "mp_segment.h"
 
 namespace text_analysis {
 
-extern std::unordered_map<std::string, std::unique_ptr<DictTrie> > g_dict_tries;
+extern DictManager g_dict_manager;
 
 MPSegment::MPSegment(const Normalizer* normalizer) {
     normalizer_ = normalizer;
@@ -36,75 +40,126 @@ void MPSegment::cut(const std::string& text, std::vector<std::string>& res) cons
 void MPSegment::cut(const std::string& text,
         const std::string& country,
         std::vector<std::string>& res) const {
+    SegmentContext ctx;
+    cut(text, country, ctx, res);
+}
+
+void MPSegment::cut(const std::string& text,
+        const std::string& country,
+        std::vector<TokenSpan>& spans) const {
+    SegmentContext ctx;
+    cut(text, country, ctx, spans);
+}
+
+void MPSegment::cut(const std::string& text,
+        const std::string& country,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
+    // 持有词典直到分词结束, 期间被淘汰也不会析构
+    cut(text, g_dict_manager.resolve(country), ctx, res);
+}
+
+void MPSegment::cut(const std::string& text,
+        const std::string& country,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    cut(text, g_dict_manager.resolve(country), ctx, spans);
+}
+
+void MPSegment::cut(const std::string& text,
+        const CountryHandle& handle,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
     // lower
-    std::string lower_text(text);
-    StringUtil::toLowerCase(lower_text);
-    // 默认分词, 保持一致
-    if (g_dict_tries.find(country) == g_dict_tries.end()) {
-        cut(lower_text, res);
+    ctx.lower_text.assign(text);
+    StringUtil::toLowerCase(ctx.lower_text);
+    if (!cut(handle, ctx)) {
+        cut(ctx.lower_text, res);
         return;
     }
-    res.clear();
-    std::vector<WordRange> word_ranges;
-    std::vector<Word> words;
-    RuneStringArray runes;
-    if (!decodeRunesInString(lower_text, runes)) {
-        // TODO(philister): add log
-        cut(lower_text, res);
+    getStringsFromWordRanges(ctx.lower_text, ctx.word_ranges, res);
+}
+
+void MPSegment::cut(const std::string& text,
+        const CountryHandle& handle,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    ctx.lower_text.assign(text);
+    StringUtil::toLowerCase(ctx.lower_text);
+    if (!cut(handle, ctx)) {
+        spans.assign(1, getSpanOfString(text));
         return;
     }
-    if (runes.empty()) {
-        return;
+    getSpansFromWordRanges(ctx.word_ranges, spans);
+}
+
+// 词典不存在或者解码失败时返回false, 整个text作为一个词
+bool MPSegment::cut(const CountryHandle& handle, SegmentContext& ctx) const {
+    ctx.word_ranges.clear();
+    // 先解码, 没有词典时decode_error同样有效
+    // 非法输入不在这里打日志(调用频繁), 位置留在ctx.decode_error, 由传入ctx的调用方读取
+    if (!decodeRunesInString(ctx.lower_text, ctx.runes, ctx.decode_error)) {
+        return false;
+    }
+    // 默认分词, 保持一致
+    if (!handle.valid()) {
+        return false;
+    }
+    if (ctx.runes.empty()) {
+        return true;
     }
     if (normalizer_ != NULL) {
-        normalizer_->normalize(runes, word_ranges);
-        cut(lower_text, country, word_ranges, words, MAX_WORD_LENGTH);
+        normalizer_->normalize(ctx);
+        const DictTrie* dict = handle.dict();
+        const std::vector<WordRange>& ranges = ctx.norm_ranges;
+        // 大文本分片并发, 每个分片写入各自的shard_ctx
+        bool sharded = cutShards(ctx, [this, dict, &ranges](SegmentContext& shard_ctx, size_t begin, size_t end) {
+            cut(dict, ranges.begin() + begin, ranges.begin() + end, shard_ctx, MAX_WORD_LENGTH);
+        });
+        if (!sharded) {
+            cut(dict, ranges.begin(), ranges.end(), ctx, MAX_WORD_LENGTH);
+        }
     } else {
-        cut(lower_text, country, words, MAX_WORD_LENGTH);
+        cut(handle.dict(), ctx, MAX_WORD_LENGTH);
     }
-    getStringsFromWords(words, res);
+    return true;
 }
 
-void MPSegment::cut(const std::string& text,
-        const std::string& country,
-        std::vector<std::string>& words,
-        size_t max_word_len) const {
-    std::vector<Word> tmp;
-    cut(text, country, tmp, max_word_len);
-    getStringsFromWords(tmp, words);
+bool MPSegment::cutNormalized(const CountryHandle& handle,
+        SegmentContext& ctx,
+        size_t range_begin,
+        size_t range_end) const {
+    if (!handle.valid()) {
+        return false;
+    }
+    cut(handle.dict(), ctx.norm_ranges.begin() + range_begin, ctx.norm_ranges.begin() + range_end,
+            ctx, MAX_WORD_LENGTH);
+    return true;
 }
 
-void MPSegment::cut(const std::string& text,
-        const std::string& country,
-        std::vector<Word>& words, 
+void MPSegment::cut(const DictTrie* dict_trie,
+        SegmentContext& ctx,
         size_t max_word_len) const {
     // 这里需要单例或者static方法优化吗?
-    SeparatorIter siter(symbols_, text);
+    SeparatorIter siter(symbols_, symbol_scanner_, ctx.lower_text, ctx.runes);
     WordRange range;
-    std::vector<WordRange> word_ranges;
-    word_ranges.reserve(text.size());
     // 先分句(trunk) 再分词, 不考虑合并的问题
     while (siter.hasNext()) {
         range = siter.next();
-        cut(country, range.left, range.right+1, word_ranges, max_word_len);
+        cut(dict_trie, range.left, range.right+1, ctx, max_word_len);
     }
-    words.clear();
-    words.reserve(word_ranges.size());
-    getWordsFromWordRanges(text, word_ranges, words);
 }
 
 // word_ranges, 在原数据上切分减少开销
-void MPSegment::cut(const std::string& text,
-        const std::string& country,
-        const std::vector<WordRange>& word_ranges, 
-        std::vector<Word>& words, 
+void MPSegment::cut(const DictTrie* dict_trie,
+        std::vector<WordRange>::const_iterator range_begin,
+        std::vector<WordRange>::const_iterator range_end,
+        SegmentContext& ctx,
         size_t max_word_len) const {
-    std::vector<WordRange> new_word_ranges;
-    for (std::vector<WordRange>::const_iterator it = word_ranges.begin();
-            it != word_ranges.end(); it++) {
+    for (std::vector<WordRange>::const_iterator it = range_begin; it != range_end; it++) {
         // default模式下, 数字不处理
         if (it->isALLUnicodeDigit()) {
-            new_word_ranges.push_back(*it);
+            ctx.word_ranges.push_back(*it);
             continue;
         }
         // 非ascii 不处理
@@ -119,91 +174,141 @@ void MPSegment::cut(const std::string& text,
             continue;
         }
         ********************/
-        cut(country, it->left, it->right+1, new_word_ranges, max_word_len);
+        cut(dict_trie, it->left, it->right+1, ctx, max_word_len);
     }
-    words.clear();
-    words.reserve(new_word_ranges.size());
-    getWordsFromWordRanges(text, new_word_ranges, words);
 }
 
-void MPSegment::cut(const std::string& country,
+void MPSegment::cut(const DictTrie* dict_trie,
         RuneStringArray::const_iterator begin,
         RuneStringArray::const_iterator end,
-        std::vector<WordRange>& words,
+        SegmentContext& ctx,
         size_t max_word_len) const {
-    // 获取当前输入text的DAG
-    std::vector<Dag> dags;
-    const DictTrie* dict_trie = g_dict_tries.at(country).get();
-    dict_trie->find(begin, end, dags, max_word_len);
-    calcDP(country, dags);
-    cutByDag(begin, end, dags, words);
+    // 不生成词图, 遍历trie的同时计算路径
+    TriePrefixes prefixes(dict_trie, begin, end - begin, max_word_len);
+    calcDP(dict_trie, end - begin, prefixes, ctx.lattice);
+    cutByDag(begin, end, ctx.lattice, ctx.word_ranges);
 }
 
-const DictTrie* MPSegment::getDictTrie(const std::string& country) const {
-    if (g_dict_tries.find(country) == g_dict_tries.end()) {
-        return NULL;
+void MPSegment::cutLattice(const DictTrie* dict_trie,
+        RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        Lattice& lattice,
+        std::vector<WordRange>& words) const {
+    // 只读取词图的边, 路径写入routes, 与MM共用时不影响MM的结果
+    LatticePrefixes prefixes(lattice);
+    calcDP(dict_trie, end - begin, prefixes, lattice);
+    cutByDag(begin, end, lattice, words);
+}
+
+std::shared_ptr<const DictTrie> MPSegment::getDictTrie(const std::string& country) const {
+    return g_dict_manager.get(country);
+}
+
+template <class Prefixes>
+void MPSegment::calcDP(const DictTrie* dict_trie,
+        size_t size,
+        const Prefixes& prefixes,
+        Lattice& lattice) const {
+    // 定点路径权重不低于 -2^31 * size, int64不会溢出
+    const int64_t no_fixed_route = std::numeric_limits<int64_t>::min();
+    lattice.dp_chunks++;
+    switch (dict_trie->weightType()) {
+        case DICT_WEIGHT_FIXED16:
+            lattice.fixed_dp_chunks++;
+            calcDP<int16_t>(dict_trie, no_fixed_route, size, prefixes,
+                    lattice.fixed_weights, lattice.routes);
+            break;
+        case DICT_WEIGHT_FIXED32:
+            lattice.fixed_dp_chunks++;
+            calcDP<int32_t>(dict_trie, no_fixed_route, size, prefixes,
+                    lattice.fixed_weights, lattice.routes);
+            break;
+        default:
+            calcDP<double>(dict_trie, MIN_DOUBLE, size, prefixes,
+                    lattice.weights, lattice.routes);
+            break;
     }
-    return g_dict_tries.at(country).get();
+}
+
+template <typename T, typename V, class Prefixes>
+void MPSegment::calcDP(const DictTrie* dict_trie,
+        V no_route,
+        size_t size,
+        const Prefixes& prefixes,
+        std::vector<V>& path_weights,
+        std::vector<uint32_t>& routes) const {
+    const WeightTable<T>& table = *dict_trie->getWeightTable<T>();
+    const V min_weight = V(table.minWeight());
+    const DictTrie* base = dict_trie->getBase();
+    if (base != NULL) {
+        calcDP(size, prefixes, OverlayWeights<T>(dict_trie, table, *base->getWeightTable<T>()),
+                min_weight, no_route, path_weights, routes);
+        return;
+    }
+    calcDP(size, prefixes, UnitWeights<T>(dict_trie, table),
+            min_weight, no_route, path_weights, routes);
+}
+
+// 候选路径是否优于当前最优, 浮点与定点DP使用同一规则: 并列时保留先出现的候选
+// 定点累加是精确的, 直接比较; 浮点中数学上相等的两条路径(如weight(aa) = 2 * weight(a)时的
+// aa|a 与 a|a|a)因累加顺序不同可能相差几个ulp, 相对差在1e-10以内视为并列, 否则由舍入决定
+inline bool betterRoute(int64_t val, int64_t best) {
+    return val > best;
+}
+
+inline bool betterRoute(double val, double best) {
+    return val > best + std::fabs(best) * 1e-10;
 }
 
 // jieba动态规划计算路径
-void MPSegment::calcDP(const std::string& country, std::vector<Dag>& dags) const {
-    size_t next_pos = 0;
-    const DictUnit* p;
-    double val = 0.0;
-    const DictTrie* dict_trie = g_dict_tries.at(country).get();
+// 从后向前, 每个位置遍历一次trie的同时更新最大路径, 后面位置的结果已经确定
+// 只保存每个位置的最大权重和路径, 不保存边
+template <class Prefixes, class Weights, typename V>
+void MPSegment::calcDP(size_t size,
+        const Prefixes& prefixes,
+        const Weights& get_weight,
+        V min_weight,
+        V no_route,
+        std::vector<V>& weights,
+        std::vector<uint32_t>& routes) const {
+    routes.resize(size);
+    weights.resize(size);
 
     // route[idx] = max((log(self.FREQ.get(sentence[idx:x + 1]) or 1) - logtotal + route[x + 1][0], x) for x in DAG[idx])
-    for (std::vector<Dag>::reverse_iterator rit = dags.rbegin(); rit != dags.rend(); rit++) {
-        // 默认为空, 不存在route
-        rit->p_info = NULL;
-        rit->weight = MIN_DOUBLE;
-        // assert(!rit->nexts.empty());
-        // 从后向前, DP 计算最大路径
-        // p_info 记录了当前节点weights最大的route节点
-        for (std::vector<std::pair<size_t, const DictUnit*> >::const_iterator it = rit->nexts.begin();
-                it != rit->nexts.end(); it++) {
-            next_pos = it->first;
-            p = it->second;
-            val = 0.0;
-            if (next_pos + 1 < dags.size()) {
-                val += dags[next_pos + 1].weight;
-            }
-
-            if (p) {
-                val += p->weight;
-            } else {
-                val += dict_trie->getMinWeight();
+    for (size_t i = size; i-- > 0;) {
+        // 默认为单字
+        uint32_t route = i;
+        V best = no_route;
+        prefixes(i, [&](size_t k, const DictUnit* p) {
+            const size_t next_pos = i + k;
+            V val = p ? V(get_weight(p)) : min_weight;
+            if (next_pos + 1 < size) {
+                val += weights[next_pos + 1];
             }
-            // 取最大log(freq)
-            if (val > rit->weight) {
-                rit->p_info = p;
-                rit->weight = val;
-            }
-        }
+            // 取最大log(freq), 条件赋值代替分支(定点时为cmov), 候选之间没有可预测的规律
+            // 并列时保留先出现(较短)的词, 见betterRoute
+            const bool better = betterRoute(val, best);
+            route = better ? uint32_t(next_pos) : route;
+            best = better ? val : best;
+        });
+        routes[i] = route;
+        weights[i] = best;
     }
 }
 
 void MPSegment::cutByDag(RuneStringArray::const_iterator begin, 
         RuneStringArray::const_iterator end,
-        const std::vector<Dag>& dags, 
+        const Lattice& lattice, 
         std::vector<WordRange>& words) const {
     size_t i = 0;
-    while (i < dags.size()) {
-        const DictUnit* p = dags[i].p_info;
-        if (p) {
-            // assert(p->word.size() >= 1);
-            WordRange wr(begin + i, begin + i + p->word.size() - 1);
-            words.push_back(wr);
-            i += p->word.size();
-        } else { // single word
-            WordRange wr(begin + i, begin + i);
-            words.push_back(wr);
-            i++;
-      }
+    while (i < size_t(end - begin)) {
+        // 单字时route为自身
+        size_t last = lattice.routes[i];
+        WordRange wr(begin + i, begin + last);
+        words.push_back(wr);
+        i = last + 1;
     }
 }
-
 }
 
 
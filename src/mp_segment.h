@@ -13,9 +13,13 @@
 #ifndef TEXT_ANALYSIS_MP_SEGMENT_H
 #define TEXT_ANALYSIS_MP_SEGMENT_H
 
+#include <algorithm>
+
 #include "segment_base.h"
 #include "dict_trie.h"
+#include "dict_manager.h"
 #include "normalizer.h"
+#include "segment_context.h"
 
 namespace text_analysis {
 
@@ -24,39 +28,155 @@ public:
     // 传入trie词典
     MPSegment(const Normalizer* normalizer);
     ~MPSegment();
+    using SegmentBase::setShardExecutor;
 
     void cut(const std::string& text, std::vector<std::string>& res) const;
     void cut(const std::string& text, const std::string& country, std::vector<std::string>& res) const;
-private:
-    const DictTrie* getDictTrie(const std::string& country) const;
-
+    // 只返回每个词在text中的位置, 不复制字符串
+    void cut(const std::string& text, const std::string& country, std::vector<TokenSpan>& spans) const;
+    // 复用ctx中的缓冲区, 预热后不再分配内存(字符串结果除外)
     void cut(const std::string& text,
             const std::string& country,
-            std::vector<std::string>& res,
-            size_t max_word_len) const;
-
+            SegmentContext& ctx,
+            std::vector<std::string>& res) const;
     void cut(const std::string& text,
             const std::string& country,
-            std::vector<Word>& words,
+            SegmentContext& ctx,
+            std::vector<TokenSpan>& spans) const;
+    // 已解析的地区, 分词过程不再查找词典
+    void cut(const std::string& text,
+            const CountryHandle& handle,
+            SegmentContext& ctx,
+            std::vector<std::string>& res) const;
+    void cut(const std::string& text,
+            const CountryHandle& handle,
+            SegmentContext& ctx,
+            std::vector<TokenSpan>& spans) const;
+    // 流式分词: ctx.norm_ranges[range_begin, range_end)为已归一化的结果, 分词结果追加到ctx.word_ranges
+    // handle无效时返回false
+    bool cutNormalized(const CountryHandle& handle,
+            SegmentContext& ctx,
+            size_t range_begin,
+            size_t range_end) const;
+    // 在已生成的词图上分词(与MM共用词图), lattice为dict_trie->find对[begin, end)的结果
+    // 只改写lattice的路径数组, 结果追加到words
+    void cutLattice(const DictTrie* dict_trie,
+            RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            Lattice& lattice,
+            std::vector<WordRange>& words) const;
+private:
+    std::shared_ptr<const DictTrie> getDictTrie(const std::string& country) const;
+
+    // ctx.lower_text => ctx.word_ranges, 词典不存在或者解码失败时返回false
+    // 总是先解码, 可以用ctx.decode_error区分两者
+    bool cut(const CountryHandle& handle, SegmentContext& ctx) const;
+
+    // 未归一化时按分隔符分块
+    void cut(const DictTrie* dict_trie,
+            SegmentContext& ctx,
             size_t max_word_len) const;
     
-    void cut(const std::string& text,
-            const std::string& country,
-            const std::vector<WordRange>& word_ranges, 
-            std::vector<Word>& words, 
+    // 归一化结果中的 [range_begin, range_end)
+    void cut(const DictTrie* dict_trie,
+            std::vector<WordRange>::const_iterator range_begin,
+            std::vector<WordRange>::const_iterator range_end,
+            SegmentContext& ctx,
             size_t max_word_len) const;
 
-    // 传入const_iter防止复制,修改等操作
-    void cut(const std::string& country,
+    // 传入const_iter防止复制,修改等操作, 结果追加到ctx.word_ranges
+    void cut(const DictTrie* dict_trie,
             RuneStringArray::const_iterator begin,
             RuneStringArray::const_iterator end,
-            std::vector<WordRange>& words,
+            SegmentContext& ctx,
             size_t max_word_len) const; 
    
-    void calcDP(const std::string& country, std::vector<Dag>& dags) const;
+    // 以位置i开始的词: prefixes(i, visit), 按词长升序调用visit(k, unit), 与DictTrie::findPrefixes一致
+    // 遍历trie, 不生成词图
+    struct TriePrefixes {
+        TriePrefixes(const DictTrie* dict_trie,
+                RuneStringArray::const_iterator begin,
+                size_t size,
+                size_t max_word_len)
+            : dict_trie(dict_trie), begin(begin), size(size), max_word_len(max_word_len) {
+        }
+        template <class Visit>
+        void operator()(size_t i, Visit visit) const {
+            dict_trie->findPrefixes(begin + i, begin + std::min(size, i + max_word_len), visit);
+        }
+        const DictTrie* dict_trie;
+        RuneStringArray::const_iterator begin;
+        size_t size;
+        size_t max_word_len;
+    };
+    // 已生成的词图(DictTrie::find), 每个位置的边与findPrefixes的顺序一致
+    struct LatticePrefixes {
+        explicit LatticePrefixes(const Lattice& lattice): lattice(lattice) {
+        }
+        template <class Visit>
+        void operator()(size_t i, Visit visit) const {
+            for (const LatticeEdge* e = lattice.edgeBegin(i); e != lattice.edgeEnd(i); e++) {
+                visit(e->end - i, e->unit);
+            }
+        }
+        const Lattice& lattice;
+    };
+    // 词典权重表中的数组: 权重类型与是否为用户词典在每个分块开始时确定, 内层循环只做一次数组访问
+    template <typename T>
+    struct UnitWeights {
+        UnitWeights(const DictTrie* dict_trie, const WeightTable<T>& table)
+            : units(dict_trie->getUnits().data()), weights(table.data()) {
+        }
+        T operator()(const DictUnit* p) const {
+            return weights[p - units];
+        }
+        const DictUnit* units;
+        const T* weights;
+    };
+    // 用户词典: 自身的词取自身的权重, 其余取基础词典的权重
+    template <typename T>
+    struct OverlayWeights {
+        OverlayWeights(const DictTrie* dict_trie, const WeightTable<T>& own_table,
+                const WeightTable<T>& base_table)
+            : own(dict_trie, own_table),
+            base(dict_trie->getBase(), base_table),
+            own_end(own.units + dict_trie->getUnits().size()) {
+        }
+        T operator()(const DictUnit* p) const {
+            std::less<const DictUnit*> less;
+            return !less(p, own.units) && less(p, own_end) ? own(p) : base(p);
+        }
+        UnitWeights<T> own;
+        UnitWeights<T> base;
+        const DictUnit* own_end;
+    };
+
+    // 按词典的权重类型选择DP: 浮点权重累加double, 定点权重累加int64
+    // 结果写入lattice.routes, 只使用lattice的路径数组
+    template <class Prefixes>
+    void calcDP(const DictTrie* dict_trie,
+            size_t size,
+            const Prefixes& prefixes,
+            Lattice& lattice) const;
+    // 按是否为用户词典选择权重访问方式, 用户词典与基础词典的权重类型相同
+    template <typename T, typename V, class Prefixes>
+    void calcDP(const DictTrie* dict_trie,
+            V no_route,
+            size_t size,
+            const Prefixes& prefixes,
+            std::vector<V>& path_weights,
+            std::vector<uint32_t>& routes) const;
+    template <class Prefixes, class Weights, typename V>
+    void calcDP(size_t size,
+            const Prefixes& prefixes,
+            const Weights& get_weight,
+            V min_weight,
+            V no_route,
+            std::vector<V>& path_weights,
+            std::vector<uint32_t>& routes) const;
     void cutByDag(RuneStringArray::const_iterator begin,
             RuneStringArray::const_iterator end,
-            const std::vector<Dag>& dags,
+            const Lattice& lattice,
             std::vector<WordRange>& words) const;
 private:
     // 标准化
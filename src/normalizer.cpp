@@ -10,6 +10,7 @@
  * 
  * =====================================================================================
  */
+#include "make_unique.h"
 #include "nlp_stringutil.h"
 #include "normalizer.h"
 
@@ -18,11 +19,15 @@ namespace text_analysis {
 Normalizer::Normalizer(const std::string& stop_words_path) {
     stop_trie_ = new DictTrie(stop_words_path);
     need_destroy_ = true;
+    stop_matcher_ = std::make_unique<AhoCorasick>(*stop_trie_, MAX_WORD_LENGTH);
 }
 
 Normalizer::Normalizer(const DictTrie* stop_trie) {
     stop_trie_ = stop_trie;
     need_destroy_ = false;
+    if (stop_trie_ != NULL) {
+        stop_matcher_ = std::make_unique<AhoCorasick>(*stop_trie_, MAX_WORD_LENGTH);
+    }
 }
 
 Normalizer::~Normalizer() {
@@ -42,45 +47,106 @@ std::string Normalizer::normalize(const std::string& text) const {
 }
 
 bool Normalizer::normalize(const std::string& text, std::vector<std::string>& res) const {
-    std::vector<Word> words;
-    res.clear();
-    if (!normalize(text, words)) {
+    SegmentContext ctx;
+    return normalize(text, ctx, res);
+}
+
+bool Normalizer::normalize(const std::string& text,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
+    if (!decodeAndNormalize(text, ctx)) {
+        res.clear();
         return false;
     }
-    getStringsFromWords(words, res);
+    getStringsFromWordRanges(ctx.lower_text, ctx.norm_ranges, res);
     return true;
 }
 
 bool Normalizer::normalize(const std::string& text, std::vector<Word>& words) const {
     words.clear();
-    std::vector<WordRange> word_ranges;
-    word_ranges.reserve(text.size());
+    SegmentContext ctx;
+    if (!decodeAndNormalize(text, ctx)) {
+        return false;
+    }
+    getWordsFromWordRanges(ctx.lower_text, ctx.norm_ranges, words);
+    return true;
+}
+
+bool Normalizer::normalize(const std::string& text, std::vector<TokenSpan>& spans) const {
+    SegmentContext ctx;
+    return normalize(text, ctx, spans);
+}
+
+bool Normalizer::normalize(const std::string& text,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    if (!decodeAndNormalize(text, ctx)) {
+        spans.clear();
+        return false;
+    }
+    getSpansFromWordRanges(ctx.norm_ranges, spans);
+    return true;
+}
+
+bool Normalizer::decodeAndNormalize(const std::string& text, SegmentContext& ctx) const {
     // lower
-    std::string lower_text(text);
-    StringUtil::toLowerCase(lower_text);
-    RuneStringArray runes;
-    if (!decodeRunesInString(lower_text, runes)) {
+    ctx.lower_text.assign(text);
+    StringUtil::toLowerCase(ctx.lower_text);
+    ctx.norm_ranges.clear();
+    if (!decodeRunesInString(ctx.lower_text, ctx.runes, ctx.decode_error)) {
         return false;
     }
-    if (runes.empty()) {
+    if (ctx.runes.empty()) {
         return true;
     }
+    normalize(ctx);
+    return true;
+}
+
+void Normalizer::normalize(const std::string& text,
+        const RuneStringArray& runes,
+        std::vector<WordRange>& word_ranges) const {
+    std::vector<uint32_t> window;
+    std::vector<WordRange> buffer;
+    removeStopWords(text, runes.begin(), runes.end(), word_ranges, window);
+    numberSplit(word_ranges, buffer);
+}
+
+void Normalizer::normalize(SegmentContext& ctx) const {
     // 去除标点符号语表情包
-    removeStopWords(runes.begin(), runes.end(), word_ranges);
+    removeStopWords(ctx.lower_text, ctx.runes.begin(), ctx.runes.end(),
+            ctx.norm_ranges, ctx.match_window);
     // TODO(philister): 数字先独立出来, 后续根据需求处理各种特殊数字以及单位
-    numberSplit(word_ranges);
-    getWordsFromWordRanges(lower_text, word_ranges, words);
-    return true;
+    numberSplit(ctx.norm_ranges, ctx.range_buffer);
 }
 
-void Normalizer::normalize(const RuneStringArray& runes, std::vector<WordRange>& word_ranges) const {
-    // decode Rune from string
-    removeStopWords(runes.begin(), runes.end(), word_ranges);
-    numberSplit(word_ranges);
+void Normalizer::normalize(const std::string& text,
+        RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        bool final,
+        AhoCorasick::Scan& scan,
+        SegmentContext& ctx) const {
+    ctx.norm_ranges.clear();
+    if (stop_matcher_ == NULL) {
+        // 没有停用词时只有一个片段, 输入结束时才确定
+        const size_t size = end - begin;
+        scan.p = size;
+        if (final && scan.j < size) {
+            ctx.norm_ranges.push_back(WordRange(begin + scan.j, end - 1));
+            scan.i = scan.j = size;
+        }
+    } else {
+        stop_matcher_->removeMatches(text, begin, end, final, scan, ctx.norm_ranges);
+    }
+    // 数字切分只在片段内部进行
+    numberSplit(ctx.norm_ranges, ctx.range_buffer);
 }
 
-void Normalizer::numberSplit(std::vector<WordRange>& word_ranges) const {
-    std::vector<WordRange> new_word_ranges;
+// 结果先写入buffer, 再与word_ranges交换, 两者的内存都保留
+void Normalizer::numberSplit(std::vector<WordRange>& word_ranges,
+        std::vector<WordRange>& buffer) const {
+    std::vector<WordRange>& new_word_ranges = buffer;
+    new_word_ranges.clear();
     for (const auto& iter : word_ranges) {
         int old_str = 0, last_str= -1;
         int old_num = 0, last_num = -1;
@@ -108,73 +174,22 @@ void Normalizer::numberSplit(std::vector<WordRange>& word_ranges) const {
         WordRange wr(iter.left+old, iter.right);
         new_word_ranges.push_back(wr);
     } 
-    word_ranges.clear();
-    word_ranges.resize(new_word_ranges.size());
-    for (size_t i = 0; i < new_word_ranges.size(); ++i) {
-        word_ranges[i] = new_word_ranges[i];
-    }
+    word_ranges.swap(new_word_ranges);
 } 
 
-void Normalizer::removeStopWords(RuneStringArray::const_iterator begin,
+void Normalizer::removeStopWords(const std::string& text,
+        RuneStringArray::const_iterator begin,
         RuneStringArray::const_iterator end,
-        std::vector<WordRange>& word_ranges) const {
-    std::vector<Dag> dags;
-    // 默认长度与分词字典一致
-    bool need_remove = false;
-    if (stop_trie_ != NULL) {
-        stop_trie_->find(begin, end, dags, MAX_WORD_LENGTH);
-        need_remove = callStopWords(dags);
-    }
-    removeByDag(begin, end, dags, word_ranges, need_remove);
-} 
-
-bool Normalizer::callStopWords(std::vector<Dag>& dags) const {
-    for (std::vector<Dag>::iterator it = dags.begin(); it != dags.end(); it++) {
-        it->p_info = NULL;
-        it->weight = 0.0; 
-
-        if (it->nexts.empty()) {
-            return false;
-        }
-        // 直接取最后一个item
-        it->next_pos = it->nexts.back().first;
-        it->p_info = it->nexts.back().second;
-    }
-    return true;
-} 
-
-void Normalizer::removeByDag(RuneStringArray::const_iterator begin, 
-        RuneStringArray::const_iterator end,
-        const std::vector<Dag>& dags, 
         std::vector<WordRange>& word_ranges,
-        bool need_remove) const {
+        std::vector<uint32_t>& window) const {
     word_ranges.clear();
-    if (!need_remove) {
-        WordRange wr(begin, end-1);
-        word_ranges.push_back(wr);
+    // 默认长度与分词字典一致, 从左到右取最长的停用词
+    if (stop_matcher_ == NULL) {
+        word_ranges.push_back(WordRange(begin, end - 1));
         return;
     }
-    size_t i = 0;
-    size_t j = 0;
-    while (i < dags.size()) {
-        const auto& p_word = dags[i].p_info;
-        // 停用词
-        if (p_word != NULL) {
-            if (i != 0 and i > j) {
-                WordRange wr(begin+j, begin+i-1);
-                word_ranges.push_back(wr);
-            }
-            i += p_word->word.size();
-            j = i;
-        } else {
-            ++i;
-        }
-    }
-    if (j < dags.size()) {
-        WordRange wr(begin+j, end-1);
-        word_ranges.push_back(wr);
-    }
-}
+    stop_matcher_->removeMatches(text, begin, end, word_ranges, window);
+} 
 
 }
 
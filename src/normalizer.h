@@ -13,7 +13,11 @@
 #ifndef TEXT_ANALYSIS_NORMALIZER_H
 #define TEXT_ANALYSIS_NORMALIZER_H
 
+#include <memory>
+
 #include "dict_trie.h"
+#include "aho_corasick.h"
+#include "segment_context.h"
 
 namespace text_analysis {
 
@@ -26,27 +30,48 @@ public:
     ~Normalizer();
 
     bool normalize(const std::string& text, std::vector<std::string>& res) const;
+    // 复用ctx中的缓冲区
+    bool normalize(const std::string& text, SegmentContext& ctx, std::vector<std::string>& res) const;
     std::string normalize(const std::string& text) const;
     bool normalize(const std::string& text, std::vector<Word>& words) const;
-    void normalize(const RuneStringArray&runes, std::vector<WordRange>& word_ranges) const;
+    // 只返回每个词在text中的位置, 不复制字符串
+    bool normalize(const std::string& text, std::vector<TokenSpan>& spans) const;
+    bool normalize(const std::string& text, SegmentContext& ctx, std::vector<TokenSpan>& spans) const;
+    // runes为text解码的结果
+    void normalize(const std::string& text,
+            const RuneStringArray& runes,
+            std::vector<WordRange>& word_ranges) const;
+    // ctx.lower_text/ctx.runes => ctx.norm_ranges
+    void normalize(SegmentContext& ctx) const;
+    // 流式输入: 从scan继续归一化[begin, end), 只把之后不会再变化的片段写入ctx.norm_ranges
+    // final为true时输入已结束, 输出剩余的全部片段; 各次的结果连起来与一次normalize一致
+    void normalize(const std::string& text,
+            RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            bool final,
+            AhoCorasick::Scan& scan,
+            SegmentContext& ctx) const;
+    // 最长停用词的rune数, 没有停用词时为0
+    size_t maxStopWordLength() const {
+        return stop_matcher_ ? stop_matcher_->maxLength() : 0;
+    }
 private:
+    // text小写后写入ctx.lower_text, 解码并归一化
+    bool decodeAndNormalize(const std::string& text, SegmentContext& ctx) const;
     // 数字处理, 考虑优化
-    void numberSplit(std::vector<WordRange>& word_ranges) const; 
+    void numberSplit(std::vector<WordRange>& word_ranges, std::vector<WordRange>& buffer) const; 
     // 停用词处理
-    void removeStopWords(RuneStringArray::const_iterator begin,
-            RuneStringArray::const_iterator end,
-            std::vector<WordRange>& word_ranges) const; 
-
-    bool callStopWords(std::vector<Dag>& dags) const;
-    void removeByDag(RuneStringArray::const_iterator begin,
+    void removeStopWords(const std::string& text,
+            RuneStringArray::const_iterator begin,
             RuneStringArray::const_iterator end,
-            const std::vector<Dag>& dags,
-            std::vector<WordRange>& words,
-            bool need_remove) const;
+            std::vector<WordRange>& word_ranges,
+            std::vector<uint32_t>& window) const; 
 private:
     // 停用词词典
     const DictTrie* stop_trie_ = NULL;
     bool need_destroy_ = false;
+    // 停用词自动机, 一次扫描去除停用词
+    std::unique_ptr<AhoCorasick> stop_matcher_;
 };
 
 }
@@ -0,0 +1,227 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  perfect_hash.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/21 15:08:44
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <string.h>
+#include <algorithm>
+
+#include "perfect_hash.h"
+
+namespace text_analysis {
+
+namespace {
+
+// 换种子重试的次数
+const uint64_t MAX_SEED_TRIES = 16;
+// 单个桶的pilot上限, 超过时换种子
+const uint32_t MAX_PILOT = 1 << 24;
+
+}
+
+// MurmurHash64A
+uint64_t hashBytes(const char* data, size_t len, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    const char* end = data + (len & ~size_t(7));
+    for (const char* p = data; p != end; p += 8) {
+        uint64_t k = 0;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    const unsigned char* tail = reinterpret_cast<const unsigned char*>(end);
+    switch (len & 7) {
+        case 7: h ^= uint64_t(tail[6]) << 48;  // fall through
+        case 6: h ^= uint64_t(tail[5]) << 40;  // fall through
+        case 5: h ^= uint64_t(tail[4]) << 32;  // fall through
+        case 4: h ^= uint64_t(tail[3]) << 24;  // fall through
+        case 3: h ^= uint64_t(tail[2]) << 16;  // fall through
+        case 2: h ^= uint64_t(tail[1]) << 8;  // fall through
+        case 1: h ^= uint64_t(tail[0]);
+                h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+bool PerfectHash::build(const std::string& keys, const std::vector<uint32_t>& offsets) {
+    for (uint64_t seed = 0; seed < MAX_SEED_TRIES; seed++) {
+        if (build(keys, offsets, seed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PerfectHash::build(const std::string& keys,
+        const std::vector<uint32_t>& offsets,
+        uint64_t seed) {
+    const size_t key_count = offsets.empty() ? 0 : offsets.size() - 1;
+    std::vector<std::pair<uint64_t, int32_t> > items(key_count);
+    for (size_t i = 0; i < key_count; i++) {
+        items[i].first = hashBytes(keys.data() + offsets[i], offsets[i + 1] - offsets[i], seed);
+        items[i].second = i;
+    }
+    std::sort(items.begin(), items.end());
+    // 相同hash的key必须相同, 保留最后一个; 否则换种子
+    size_t size = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (size > 0 && items[size - 1].first == items[i].first) {
+            int32_t last = items[size - 1].second;
+            int32_t cur = items[i].second;
+            if (keys.compare(offsets[last], offsets[last + 1] - offsets[last],
+                        keys, offsets[cur], offsets[cur + 1] - offsets[cur]) != 0) {
+                return false;
+            }
+            items[size - 1].second = cur;
+            continue;
+        }
+        items[size++] = items[i];
+    }
+    items.resize(size);
+
+    std::vector<uint64_t> params(PARAM_COUNT, 0);
+    const uint64_t bucket_count = std::max(size / BUCKET_SIZE, size_t(1));
+    const size_t table_size = size + size / TABLE_SLACK + 1;
+    params[PARAM_SEED] = seed;
+    params[PARAM_BUCKETS] = bucket_count;
+    params[PARAM_TABLE] = table_size;
+
+    // 按桶分组, key多的桶先放
+    std::vector<uint32_t> bucket_begin(bucket_count + 1, 0);
+    for (size_t i = 0; i < size; i++) {
+        bucket_begin[bucket(items[i].first, bucket_count) + 1]++;
+    }
+    for (size_t b = 0; b < bucket_count; b++) {
+        bucket_begin[b + 1] += bucket_begin[b];
+    }
+    std::vector<uint32_t> bucket_items(size);
+    std::vector<uint32_t> fill(bucket_begin.begin(), bucket_begin.end() - 1);
+    for (size_t i = 0; i < size; i++) {
+        bucket_items[fill[bucket(items[i].first, bucket_count)]++] = i;
+    }
+    std::vector<uint32_t> order(bucket_count);
+    for (size_t b = 0; b < bucket_count; b++) {
+        order[b] = b;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return bucket_begin[lhs + 1] - bucket_begin[lhs] > bucket_begin[rhs + 1] - bucket_begin[rhs];
+    });
+
+    std::vector<uint32_t> pilots(bucket_count, 0);
+    std::vector<uint64_t> fingerprints(table_size, 0);
+    std::vector<int32_t> values(table_size, -1);
+    std::vector<size_t> positions;
+    for (size_t k = 0; k < bucket_count; k++) {
+        uint32_t b = order[k];
+        if (bucket_begin[b] == bucket_begin[b + 1]) {
+            break;
+        }
+        uint32_t pilot = 0;
+        for (; pilot < MAX_PILOT; pilot++) {
+            positions.clear();
+            bool ok = true;
+            for (uint32_t i = bucket_begin[b]; i < bucket_begin[b + 1] && ok; i++) {
+                size_t pos = position(items[bucket_items[i]].first, pilot, table_size);
+                ok = values[pos] < 0
+                    && std::find(positions.begin(), positions.end(), pos) == positions.end();
+                positions.push_back(pos);
+            }
+            if (ok) {
+                break;
+            }
+        }
+        if (pilot == MAX_PILOT) {
+            return false;
+        }
+        pilots[b] = pilot;
+        for (uint32_t i = bucket_begin[b]; i < bucket_begin[b + 1]; i++) {
+            const std::pair<uint64_t, int32_t>& item = items[bucket_items[i]];
+            size_t pos = position(item.first, pilot, table_size);
+            fingerprints[pos] = item.first;
+            values[pos] = item.second;
+        }
+    }
+    // [size, table_size)中占用的槽位依次搬到[0, size)的空位
+    std::vector<uint32_t> remap(table_size - size, 0);
+    size_t free_slot = 0;
+    for (size_t pos = size; pos < table_size; pos++) {
+        if (values[pos] < 0) {
+            continue;
+        }
+        while (values[free_slot] >= 0) {
+            free_slot++;
+        }
+        remap[pos - size] = free_slot;
+        fingerprints[free_slot] = fingerprints[pos];
+        values[free_slot] = values[pos];
+    }
+    fingerprints.resize(size);
+    values.resize(size);
+
+    params_.assign(params);
+    pilots_.assign(pilots);
+    remap_.assign(remap);
+    fingerprints_.assign(fingerprints);
+    values_.assign(values);
+    return true;
+}
+
+bool PerfectHash::load(const DictImage& image, size_t value_count) {
+    if (!image.getSection(SECTION_HASH_PARAMS, params_)
+            || !image.getSection(SECTION_HASH_PILOTS, pilots_)
+            || !image.getSection(SECTION_HASH_REMAP, remap_)
+            || !image.getSection(SECTION_HASH_FINGERPRINTS, fingerprints_)
+            || !image.getSection(SECTION_HASH_VALUES, values_)) {
+        return false;
+    }
+    if (fingerprints_.size() != values_.size()) {
+        return false;
+    }
+    if (values_.empty()) {
+        return true;
+    }
+    if (params_.size() != PARAM_COUNT || params_[PARAM_BUCKETS] == 0
+            || pilots_.size() != params_[PARAM_BUCKETS]
+            || params_[PARAM_TABLE] < values_.size()
+            || remap_.size() != params_[PARAM_TABLE] - values_.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < remap_.size(); i++) {
+        if (remap_[i] >= values_.size()) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < values_.size(); i++) {
+        if (values_[i] < -1 || values_[i] >= int64_t(value_count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PerfectHash::save(DictImageWriter& writer) const {
+    writer.addSection(SECTION_HASH_PARAMS, params_);
+    writer.addSection(SECTION_HASH_PILOTS, pilots_);
+    writer.addSection(SECTION_HASH_REMAP, remap_);
+    writer.addSection(SECTION_HASH_FINGERPRINTS, fingerprints_);
+    writer.addSection(SECTION_HASH_VALUES, values_);
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
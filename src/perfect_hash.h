@@ -0,0 +1,104 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  perfect_hash.h 
+ *    Description:  词的utf8字节序列 => 下标 的最小完美哈希, 用于精确查词 
+ * 
+ *        Created:  2022/03/21 15:08:36
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_PERFECT_HASH_H
+#define TEXT_ANALYSIS_PERFECT_HASH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "pod_array.h"
+#include "dict_image.h"
+
+namespace text_analysis {
+
+uint64_t hashBytes(const char* data, size_t len, uint64_t seed);
+
+// hash-and-displace(PTHash): key先按hash分桶, 每个桶找一个pilot, 使桶内全部key落在空闲槽位
+//   pos = (h ^ mix(pilot)) % m, m略大于key数n, 方便查找pilot
+// 落在[n, m)的槽位通过remap映射到[0, n)中空出来的槽位, 保证最小
+// 每个槽位保存key的64位hash作为指纹, 不在集合中的key查找时通过指纹过滤
+// 查找只需要一次hash和一次比较, 不分配内存
+// 不保存key本身, 判断是否存在只看指纹: 不在集合中的key每次查找有约2^-64的概率误报,
+// 需要确定结果时由调用方与返回下标对应的key比较(见DictTrie::findWord)
+class PerfectHash {
+public:
+    PerfectHash() {
+    }
+    ~PerfectHash() {
+    }
+
+    // 第i个key为 keys[offsets[i], offsets[i+1]), 重复的key取最后一个
+    bool build(const std::string& keys, const std::vector<uint32_t>& offsets);
+    // 下标须小于value_count, 槽位与桶的下标都在数组范围内, 否则返回false
+    bool load(const DictImage& image, size_t value_count);
+    void save(DictImageWriter& writer) const;
+
+    // 返回key的下标, 不存在返回-1; 指纹相同的其他key也会返回下标(误报), 见上
+    int32_t find(const char* data, size_t len) const {
+        if (values_.empty()) {
+            return -1;
+        }
+        uint64_t h = hashBytes(data, len, seed());
+        size_t pos = position(h, pilots_[bucket(h, params_[PARAM_BUCKETS])], params_[PARAM_TABLE]);
+        if (pos >= values_.size()) {
+            pos = remap_[pos - values_.size()];
+        }
+        return fingerprints_[pos] == h ? values_[pos] : -1;
+    }
+
+    size_t memoryUsage() const {
+        return params_.bytes() + pilots_.bytes() + remap_.bytes()
+            + fingerprints_.bytes() + values_.bytes();
+    }
+private:
+    bool build(const std::string& keys, const std::vector<uint32_t>& offsets, uint64_t seed);
+
+    uint64_t seed() const {
+        return params_[PARAM_SEED];
+    }
+    static size_t bucket(uint64_t h, uint64_t bucket_count) {
+        return ((h >> 32) * bucket_count) >> 32;
+    }
+    static size_t position(uint64_t h, uint32_t pilot, size_t size) {
+        return (h ^ mixPilot(pilot)) % size;
+    }
+    static uint64_t mixPilot(uint64_t pilot) {
+        pilot = (pilot + 1) * 0x9e3779b97f4a7c15ULL;
+        pilot ^= pilot >> 31;
+        return pilot * 0xbf58476d1ce4e5b9ULL;
+    }
+private:
+    enum {
+        PARAM_SEED = 0,
+        PARAM_BUCKETS = 1,
+        PARAM_TABLE = 2,
+        PARAM_COUNT = 3,
+    };
+    // 平均每个桶的key数
+    static const size_t BUCKET_SIZE = 2;
+    // 槽位数 m = n + n / TABLE_SLACK + 1
+    static const size_t TABLE_SLACK = 50;
+
+    PodArray<uint64_t> params_;
+    PodArray<uint32_t> pilots_;
+    PodArray<uint32_t> remap_;
+    PodArray<uint64_t> fingerprints_;
+    PodArray<int32_t> values_;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_PERFECT_HASH_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,82 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  pod_array.h 
+ *    Description:  只读POD数组, 数据可以自己持有, 也可以指向mmap的词典镜像 
+ * 
+ *        Created:  2022/03/02 15:10:12
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_POD_ARRAY_H
+#define TEXT_ANALYSIS_POD_ARRAY_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace text_analysis {
+
+template <typename T>
+class PodArray {
+public:
+    PodArray(): data_(NULL), size_(0) {
+    }
+    PodArray(const PodArray&) = delete;
+    PodArray& operator=(const PodArray&) = delete;
+
+    // 接管构建好的数据, values会被清空
+    // 容量与大小一致时(预留准确)直接转移, 否则收缩一次
+    void assign(std::vector<T>& values) {
+        values.shrink_to_fit();
+        owned_.swap(values);
+        std::vector<T>().swap(values);
+        data_ = owned_.empty() ? NULL : owned_.data();
+        size_ = owned_.size();
+    }
+    // 指向外部内存, 不负责释放
+    void attach(const T* data, size_t size) {
+        std::vector<T>().swap(owned_);
+        data_ = data;
+        size_ = size;
+    }
+    void clear() {
+        attach(NULL, 0);
+    }
+
+    const T& operator[](size_t i) const {
+        return data_[i];
+    }
+    const T* data() const {
+        return data_;
+    }
+    const T* begin() const {
+        return data_;
+    }
+    const T* end() const {
+        return data_ + size_;
+    }
+    size_t size() const {
+        return size_;
+    }
+    size_t bytes() const {
+        return size_ * sizeof(T);
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    bool owned() const {
+        return !owned_.empty();
+    }
+private:
+    std::vector<T> owned_;
+    const T* data_;
+    size_t size_;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_POD_ARRAY_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,56 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  segment_base.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/28 15:20:11
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <algorithm>
+
+#include "segment_base.h"
+
+namespace text_analysis {
+
+bool SegmentBase::splitShards(SegmentContext& ctx) const {
+    if (!shard_executor_ || shard_runes_ == 0 || max_shards_ < 2) {
+        return false;
+    }
+    const std::vector<WordRange>& ranges = ctx.norm_ranges;
+    size_t rune_num = 0;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        rune_num += ranges[i].length();
+    }
+    size_t shard_num = std::min(rune_num / shard_runes_, max_shards_);
+    if (shard_num < 2) {
+        return false;
+    }
+
+    // 第k个分片在累计rune数达到总数的 (k+1)/shard_num 时结束
+    std::vector<size_t>& bounds = ctx.shard_bounds;
+    bounds.assign(1, 0);
+    size_t acc = 0;
+    for (size_t i = 0; i + 1 < ranges.size(); i++) {
+        acc += ranges[i].length();
+        if (acc * shard_num >= rune_num * bounds.size()) {
+            bounds.push_back(i + 1);
+        }
+    }
+    bounds.push_back(ranges.size());
+    if (bounds.size() < 3) {
+        return false;
+    }
+    // 只增不减, 复用每个分片的结果缓冲区
+    if (ctx.shard_ranges.size() < bounds.size() - 1) {
+        ctx.shard_ranges.resize(bounds.size() - 1);
+    }
+    return true;
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
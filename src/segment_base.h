@@ -18,6 +18,8 @@
 #include <unordered_set>
 
 #include "unicode.h"
+#include "ascii_scanner.h"
+#include "segment_context.h"
 
 namespace text_analysis {
 
@@ -35,6 +37,7 @@ public:
 
     bool resetSeparators(const std::string& s) {
         symbols_.clear();
+        symbol_scanner_.clear();
         RuneStringArray runes;
         if (!decodeRunesInString(s, runes)) {
             // TODO(philister): 需要增加log
@@ -44,11 +47,49 @@ public:
             if (!symbols_.insert(runes[i].rune).second) {
                 return false;
             }
+            symbol_scanner_.add(runes[i].rune);
         }
         return true;
     }
+    // 大文本分片并行: 归一化结果不少于 2 * shard_runes 个rune时, 按rune数均分为
+    // 最多max_shards个分片, 通过executor并发分词; shard_runes为0时关闭
+    // 分片边界只落在归一化结果之间, 结果与顺序分词一致; 需要在分词之前设置
+    void setShardExecutor(ShardExecutor executor, size_t shard_runes, size_t max_shards) {
+        shard_executor_ = executor;
+        shard_runes_ = shard_runes;
+        max_shards_ = max_shards;
+    }
+protected:
+    // 分片并发执行 cut_ranges(shard_ctx, begin, end), 处理ctx.norm_ranges[begin, end),
+    // 结果写入shard_ctx.word_ranges, 按分片顺序拼接到ctx.word_ranges
+    // 文本不够大或者未开启时返回false, 由调用方顺序分词(不分配内存)
+    template <class CutRanges>
+    bool cutShards(SegmentContext& ctx, CutRanges cut_ranges) const {
+        if (!splitShards(ctx)) {
+            return false;
+        }
+        const std::vector<size_t>& bounds = ctx.shard_bounds;
+        const size_t shard_num = bounds.size() - 1;
+        shard_executor_(shard_num, [&ctx, &bounds, &cut_ranges](SegmentContext& shard_ctx, size_t k) {
+            shard_ctx.word_ranges.clear();
+            cut_ranges(shard_ctx, bounds[k], bounds[k + 1]);
+            ctx.shard_ranges[k].swap(shard_ctx.word_ranges);
+        });
+        for (size_t k = 0; k < shard_num; k++) {
+            ctx.word_ranges.insert(ctx.word_ranges.end(),
+                    ctx.shard_ranges[k].begin(), ctx.shard_ranges[k].end());
+        }
+        return true;
+    }
+    // 按rune数把ctx.norm_ranges均分为分片, 写入ctx.shard_bounds; 不需要分片时返回false
+    bool splitShards(SegmentContext& ctx) const;
 protected:
     std::unordered_set<Rune> symbols_;
+    // symbols_中的ascii部分, 用于批量跳过
+    AsciiScanner symbol_scanner_;
+    ShardExecutor shard_executor_;
+    size_t shard_runes_ = 0;
+    size_t max_shards_ = 0;
 };
 
 }
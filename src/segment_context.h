@@ -0,0 +1,62 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  segment_context.h 
+ *    Description:  分词工作区, 复用分词过程中的全部缓冲区 
+ * 
+ *        Created:  2022/03/25 14:36:52
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_SEGMENT_CONTEXT_H
+#define TEXT_ANALYSIS_SEGMENT_CONTEXT_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "unicode.h"
+#include "trie.h"
+
+namespace text_analysis {
+
+// 每个线程持有一个, 传给 cut/cutMP/normalize, 不能多线程共享
+// 缓冲区只增不减, 预热之后(处理过同等长度的文本)分词不再分配内存
+// 成员为分词器内部使用, 调用方不需要访问
+struct SegmentContext {
+    // 小写后的输入
+    std::string lower_text;
+    RuneStringArray runes;
+    // 归一化结果
+    std::vector<WordRange> norm_ranges;
+    // 分词结果
+    std::vector<WordRange> word_ranges;
+    // analyze同时输出MM与MP时, MP的分词结果
+    std::vector<WordRange> mp_ranges;
+    // 数字切分的临时结果, 与norm_ranges交换
+    std::vector<WordRange> range_buffer;
+    // 停用词匹配的滑动窗口
+    std::vector<uint32_t> match_window;
+    // 当前分块的词图
+    Lattice lattice;
+    // BMM记录的MM结果
+    std::vector<size_t> positions;
+    // 分片并行: 分片k为norm_ranges[shard_bounds[k], shard_bounds[k+1]), 结果为shard_ranges[k]
+    std::vector<size_t> shard_bounds;
+    std::vector<std::vector<WordRange> > shard_ranges;
+    // 最近一次调用的输入不是合法utf8时为第一个非法序列的字节位置(此时结果为整个输入), 否则为npos
+    // 与词典是否存在无关: 无效的handle也会先解码
+    size_t decode_error = std::string::npos;
+}; // struct SegmentContext
+
+// 分片执行器: 并发执行 task(ctx, k), k in [0, n), 全部完成后返回
+// 每个执行线程传入自己的SegmentContext(不能是调用方正在使用的ctx)
+typedef std::function<void(size_t, const std::function<void(SegmentContext&, size_t)>&)> ShardExecutor;
+
+}
+
+#endif  // TEXT_ANALYSIS_SEGMENT_CONTEXT_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
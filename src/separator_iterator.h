@@ -13,17 +13,21 @@
 #ifndef TEXT_ANALYSIS_SEPARATOR_ITERATOR_H
 #define TEXT_ANALYSIS_SEPARATOR_ITERATOR_H
 
+#include <algorithm>
 #include <unordered_set>
 #include "trie.h"
+#include "ascii_scanner.h"
 
 namespace text_analysis {
 
 class SeparatorIter {
 public:
-    SeparatorIter(const std::unordered_set<Rune>& symbols, const std::string& sentence)
-        : symbols_(symbols) {
-        // add check
-        decodeRunesInString(sentence, sentence_);
+    // scanner为symbols中的ascii字符, runes为sentence解码的结果
+    SeparatorIter(const std::unordered_set<Rune>& symbols,
+            const AsciiScanner& scanner,
+            const std::string& sentence,
+            const RuneStringArray& runes)
+        : text_(sentence), sentence_(runes), symbols_(symbols), scanner_(scanner) {
         cursor_ = sentence_.begin();
     }
     ~SeparatorIter() {
@@ -37,8 +41,12 @@ public:
         WordRange range;
         range.left = cursor_;
         while (cursor_ != sentence_.end()) {
-            if (symbols_.find(cursor_->rune) == symbols_.end()) {
-                cursor_++;
+            if (!isSeparator(cursor_->rune)) {
+                // 连续的非分隔符ascii一次跳过, 字节数即rune数
+                size_t offset = cursor_->offset;
+                size_t skip = scanner_.find(text_.data() + offset,
+                        std::min(size_t(sentence_.end() - cursor_), text_.size() - offset));
+                cursor_ += std::max(skip, size_t(1));
             } else {
                 if (range.left == cursor_) {
                     range.left = ++cursor_;
@@ -63,9 +71,18 @@ public:
     }
 
 private:
-    RuneStringArray sentence_;
+    bool isSeparator(Rune rune) const {
+        if (rune < 0x80) {
+            return scanner_.contains(rune);
+        }
+        return symbols_.find(rune) != symbols_.end();
+    }
+private:
+    const std::string& text_;
+    const RuneStringArray& sentence_;
     RuneStringArray::const_iterator cursor_;
     const std::unordered_set<Rune>& symbols_;
+    const AsciiScanner& scanner_;
 };
 
 } 
@@ -0,0 +1,236 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  stream_segmenter.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/29 16:05:33
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <ctype.h>
+
+#include "stream_segmenter.h"
+#include "utf8_decoder.h"
+
+namespace text_analysis {
+
+namespace {
+
+inline bool isContinuation(uint8_t c) {
+    return (c & 0xc0) == 0x80;
+}
+
+// 去掉末尾不完整的utf8字符之后的长度, 非法字节留给解码处理
+size_t completeLength(const std::string& s) {
+    size_t size = s.size();
+    // 最多回退3个后续字节找到首字节
+    size_t lead = size;
+    while (lead > 0 && size - lead < 4) {
+        lead--;
+        if (!isContinuation(s[lead])) {
+            break;
+        }
+    }
+    if (lead == size) {
+        return size;
+    }
+    uint8_t c = s[lead];
+    size_t need = 1;
+    if (c >= 0xf0 && c <= 0xf7) {
+        need = 4;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        need = 3;
+    } else if (c >= 0xc0 && c <= 0xdf) {
+        need = 2;
+    }
+    return lead + need > size ? lead : size;
+}
+
+}
+
+StreamSegmenter::StreamSegmenter(const Normalizer* normalizer,
+        const MMSegment* mm_seg,
+        const MPSegment* mp_seg,
+        const CountryHandle& handle,
+        StreamMode mode)
+    : normalizer_(normalizer), mm_seg_(mm_seg), mp_seg_(mp_seg), handle_(handle), mode_(mode) {
+}
+
+void StreamSegmenter::feed(const char* data, size_t len, std::vector<StreamToken>& tokens) {
+    tokens.clear();
+    size_t old_size = pending_.size();
+    pending_.append(data, len);
+    // 与StringUtil::toLowerCase一致, 逐字节转换与切分位置无关
+    for (size_t i = old_size; i < pending_.size(); i++) {
+        pending_[i] = tolower(pending_[i]);
+    }
+    process(false, tokens);
+}
+
+void StreamSegmenter::feed(const std::string& chunk, std::vector<StreamToken>& tokens) {
+    feed(chunk.data(), chunk.size(), tokens);
+}
+
+size_t StreamSegmenter::feed(std::istream& in, std::vector<StreamToken>& tokens) {
+    tokens.clear();
+    size_t old_size = pending_.size();
+    pending_.resize(old_size + READ_SIZE);
+    in.read(&pending_[old_size], READ_SIZE);
+    size_t len = in.gcount();
+    pending_.resize(old_size + len);
+    if (len == 0) {
+        return 0;
+    }
+    for (size_t i = old_size; i < pending_.size(); i++) {
+        pending_[i] = tolower(pending_[i]);
+    }
+    process(false, tokens);
+    return len;
+}
+
+void StreamSegmenter::finish(std::vector<StreamToken>& tokens) {
+    tokens.clear();
+    process(true, tokens);
+    pending_.clear();
+    base_offset_ = 0;
+    base_unicode_offset_ = 0;
+    decoded_ = 0;
+    decoded_unicode_ = 0;
+    ctx_.runes.clear();
+    scan_begin_ = 0;
+}
+
+void StreamSegmenter::process(bool final, std::vector<StreamToken>& tokens) {
+    size_t complete = final ? pending_.size() : completeLength(pending_);
+    // 只解码新读入的部分
+    while (decoded_ < complete) {
+        if (decode(complete) == complete) {
+            break;
+        }
+        // 非法序列是确定的边界: 之前的部分按输入结束处理
+        flush(tokens);
+        if (!skipInvalid(final, complete, tokens)) {
+            compact();
+            return;
+        }
+    }
+    if (final) {
+        flush(tokens);
+        return;
+    }
+    // 停用词匹配从上一次停下的位置继续, 只输出已确定的片段
+    normalizer_->normalize(pending_, ctx_.runes.begin() + scan_begin_, ctx_.runes.end(),
+            false, scan_, ctx_);
+    emit(tokens);
+    if (pendingBytes() >= max_pending_) {
+        flush(tokens);
+    }
+    compact();
+}
+
+size_t StreamSegmenter::decode(size_t complete) {
+    size_t error = complete;
+    size_t error_offset = 0;
+    if (!decodeUtf8(pending_.data() + decoded_, complete - decoded_, decode_buffer_, error_offset)) {
+        error = decoded_ + error_offset;
+        decodeUtf8(pending_.data() + decoded_, error - decoded_, decode_buffer_, error_offset);
+    }
+    for (const auto& rs : decode_buffer_) {
+        ctx_.runes.push_back(rs);
+        ctx_.runes.back().offset += decoded_;
+        ctx_.runes.back().unicode_offset += decoded_unicode_;
+    }
+    decoded_ = error;
+    decoded_unicode_ += decode_buffer_.size();
+    return error;
+}
+
+// 非法序列(首字节及之后的后续字节)按一个字符单独输出
+bool StreamSegmenter::skipInvalid(bool final, size_t complete, std::vector<StreamToken>& tokens) {
+    size_t end = decoded_ + 1;
+    while (end < complete && isContinuation(pending_[end])) {
+        end++;
+    }
+    // 后续字节可能在之后的输入中继续
+    if (end == complete && !final && pendingBytes() < max_pending_) {
+        return false;
+    }
+    tokens.push_back(StreamToken(pending_.substr(decoded_, end - decoded_),
+                base_offset_ + decoded_, base_unicode_offset_ + decoded_unicode_, 1));
+    decoded_ = end;
+    decoded_unicode_++;
+    return true;
+}
+
+void StreamSegmenter::flush(std::vector<StreamToken>& tokens) {
+    normalizer_->normalize(pending_, ctx_.runes.begin() + scan_begin_, ctx_.runes.end(),
+            true, scan_, ctx_);
+    emit(tokens);
+    scan_begin_ = ctx_.runes.size();
+    scan_.reset();
+}
+
+void StreamSegmenter::emit(std::vector<StreamToken>& tokens) {
+    if (ctx_.norm_ranges.empty()) {
+        return;
+    }
+    ctx_.word_ranges.clear();
+    bool cut = false;
+    if (mode_ == STREAM_MM) {
+        cut = mm_seg_->cutNormalized(handle_, ctx_, 0, ctx_.norm_ranges.size());
+    } else if (mode_ == STREAM_MP) {
+        cut = mp_seg_->cutNormalized(handle_, ctx_, 0, ctx_.norm_ranges.size());
+    }
+    // 归一化模式或者词典不存在时输出归一化结果
+    if (!cut) {
+        ctx_.word_ranges.assign(ctx_.norm_ranges.begin(), ctx_.norm_ranges.end());
+    }
+    for (const auto& wr : ctx_.word_ranges) {
+        uint32_t len = wr.right->offset - wr.left->offset + wr.right->len;
+        uint32_t unicode_length = wr.right->unicode_offset - wr.left->unicode_offset
+            + wr.right->unicode_length;
+        tokens.push_back(StreamToken(pending_.substr(wr.left->offset, len),
+                    base_offset_ + wr.left->offset,
+                    base_unicode_offset_ + wr.left->unicode_offset,
+                    unicode_length));
+    }
+}
+
+size_t StreamSegmenter::emittedBytes() const {
+    size_t k = scan_begin_ + scan_.j;
+    return k < ctx_.runes.size() ? ctx_.runes[k].offset : decoded_;
+}
+
+// 已输出的前缀不短于剩余部分时才移动, 每个字节被移动的总次数有限
+void StreamSegmenter::compact() {
+    size_t bytes = emittedBytes();
+    if (bytes == 0 || bytes < pending_.size() - bytes) {
+        return;
+    }
+    size_t runes = scan_begin_ + scan_.j;
+    size_t unicode = runes < ctx_.runes.size() ? ctx_.runes[runes].unicode_offset
+        : decoded_unicode_;
+    pending_.erase(0, bytes);
+    ctx_.runes.erase(ctx_.runes.begin(), ctx_.runes.begin() + runes);
+    for (auto& rs : ctx_.runes) {
+        rs.offset -= bytes;
+        rs.unicode_offset -= unicode;
+    }
+    scan_.shift(scan_.j);
+    scan_begin_ = 0;
+    decoded_ -= bytes;
+    decoded_unicode_ -= unicode;
+    advance(bytes, unicode);
+}
+
+void StreamSegmenter::advance(size_t bytes, size_t runes) {
+    base_offset_ += bytes;
+    base_unicode_offset_ += runes;
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,128 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  stream_segmenter.h 
+ *    Description:  流式分词, 输入任意切分的字节块, 增量输出已确定的词 
+ * 
+ *        Created:  2022/03/29 16:05:27
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_STREAM_SEGMENTER_H
+#define TEXT_ANALYSIS_STREAM_SEGMENTER_H
+
+#include <stdint.h>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "normalizer.h"
+#include "mm_segment.h"
+#include "mp_segment.h"
+#include "segment_context.h"
+
+namespace text_analysis {
+
+enum StreamMode {
+    STREAM_NORMALIZE,  // 归一化, 同normalize
+    STREAM_MM,         // 同cut
+    STREAM_MP          // 同cutMP
+};
+
+// 流式输出的词(小写), 偏移为在整个输入流中的位置
+struct StreamToken {
+    std::string word;
+    uint64_t offset;  // 字节位置
+    uint64_t unicode_offset;
+    uint32_t unicode_length;
+
+    StreamToken(const std::string& w, uint64_t o, uint64_t unicode_offset, uint32_t unicode_length)
+        : word(w), offset(o), unicode_offset(unicode_offset), unicode_length(unicode_length) {
+    }
+}; // struct StreamToken
+
+// 输入可以在utf8字符或者词的中间断开, 结果与对整个输入调用一次normalize/cut/cutMP一致
+// 停用词之间的片段是归一化与分词的最小单位: 片段之后的停用词匹配确定之后, 之前的片段即可输出
+// 解码与停用词匹配都从上一次停下的位置继续, 每个字节只处理常数次, 与输入如何切分无关
+// 超过max_pending字节仍然没有可以确定的片段时(超长的无停用词文本), 在此处强制输出, 结果可能不同
+// 非法utf8不会使整个输入不分词: 非法序列单独作为一个词(unicode_length为1), 前后的部分照常输出
+// 不能多线程共享, 每个输入流一个
+class StreamSegmenter {
+public:
+    // 指针由TextAnalyzer持有, 不能在TextAnalyzer析构之后使用
+    StreamSegmenter(const Normalizer* normalizer,
+            const MMSegment* mm_seg,
+            const MPSegment* mp_seg,
+            const CountryHandle& handle,
+            StreamMode mode);
+    ~StreamSegmenter() {
+    }
+    StreamSegmenter(const StreamSegmenter&) = delete;
+    StreamSegmenter& operator=(const StreamSegmenter&) = delete;
+
+    // 追加输入, tokens为本次可以确定的词
+    void feed(const char* data, size_t len, std::vector<StreamToken>& tokens);
+    void feed(const std::string& chunk, std::vector<StreamToken>& tokens);
+    // 从in读取至多READ_SIZE字节, 返回读到的字节数, 0表示in已结束(之后需要调用finish)
+    size_t feed(std::istream& in, std::vector<StreamToken>& tokens);
+    // 输入结束, 输出剩余的词, 之后可以开始新的输入流
+    void finish(std::vector<StreamToken>& tokens);
+
+    // 未输出的字节数
+    size_t pendingBytes() const {
+        return pending_.size() - emittedBytes();
+    }
+    // 保留的尾部上限(字节), 默认1M
+    void setMaxPending(size_t bytes) {
+        max_pending_ = bytes;
+    }
+private:
+    // final为true时全部输出
+    void process(bool final, std::vector<StreamToken>& tokens);
+    // 解码pending_[decoded_, complete)中第一个非法序列之前的部分, 追加到ctx_.runes
+    // 返回非法序列的位置, 没有时返回complete
+    size_t decode(size_t complete);
+    // 输出decoded_处的非法序列, 需要等待之后的输入时返回false
+    bool skipInvalid(bool final, size_t complete, std::vector<StreamToken>& tokens);
+    // 输入结束或者遇到非法序列: 输出剩余的全部片段, 停用词匹配之后重新开始
+    void flush(std::vector<StreamToken>& tokens);
+    // 输出ctx_.norm_ranges
+    void emit(std::vector<StreamToken>& tokens);
+    // pending_中已输出的前缀长度
+    size_t emittedBytes() const;
+    // 去掉已输出的前缀
+    void compact();
+    void advance(size_t bytes, size_t runes);
+private:
+    static const size_t READ_SIZE = 64 * 1024;
+    static const size_t DEFAULT_MAX_PENDING = 1024 * 1024;
+
+    const Normalizer* normalizer_ = NULL;
+    const MMSegment* mm_seg_ = NULL;
+    const MPSegment* mp_seg_ = NULL;
+    // 整个输入流使用同一个词典快照
+    CountryHandle handle_;
+    StreamMode mode_;
+    size_t max_pending_ = DEFAULT_MAX_PENDING;
+    // 未输出的输入(已小写), 末尾可能是不完整的utf8字符; 已输出的前缀在compact时去掉
+    std::string pending_;
+    // pending_在输入流中的起点
+    uint64_t base_offset_ = 0;
+    uint64_t base_unicode_offset_ = 0;
+    // pending_[0, decoded_)已经解码到ctx_.runes(非法序列已输出), 其中的字符数为decoded_unicode_
+    size_t decoded_ = 0;
+    size_t decoded_unicode_ = 0;
+    RuneStringArray decode_buffer_;
+    // 停用词匹配从ctx_.runes[scan_begin_]开始, scan_为匹配的进度
+    size_t scan_begin_ = 0;
+    AhoCorasick::Scan scan_;
+    SegmentContext ctx_;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_STREAM_SEGMENTER_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
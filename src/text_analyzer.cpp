@@ -10,26 +10,149 @@
  * 
  * =====================================================================================
  */
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
 #include "make_unique.h"
 #include "nlp_stringutil.h"
+#include "thread_pool.h"
 #include "text_analyzer.h"
 
 namespace text_analysis {
 
-std::unordered_map<std::string, std::unique_ptr<DictTrie>> g_dict_tries;
+DictManager g_dict_manager;
+
+namespace {
+
+// 批量输入去重: 按下标比较 (地区, 文本), 不复制字符串
+struct BatchKeyHash {
+    BatchKeyHash(const std::vector<std::string>& sentences, const std::vector<std::string>& countries)
+        : sentences(sentences), countries(countries) {
+    }
+    size_t operator()(size_t i) const {
+        size_t h = std::hash<std::string>()(sentences[i]);
+        if (countries.size() > 1) {
+            h = h * 1000003 ^ std::hash<std::string>()(countries[i]);
+        }
+        return h;
+    }
+    const std::vector<std::string>& sentences;
+    const std::vector<std::string>& countries;
+};
+struct BatchKeyEqual {
+    BatchKeyEqual(const std::vector<std::string>& sentences, const std::vector<std::string>& countries)
+        : sentences(sentences), countries(countries) {
+    }
+    bool operator()(size_t lhs, size_t rhs) const {
+        return sentences[lhs] == sentences[rhs]
+            && (countries.size() <= 1 || countries[lhs] == countries[rhs]);
+    }
+    const std::vector<std::string>& sentences;
+    const std::vector<std::string>& countries;
+};
+
+// 每个线程(线程池线程以及调用线程)的分词缓冲区, 跨批次复用
+SegmentContext& getThreadContext() {
+    static thread_local SegmentContext ctx;
+    return ctx;
+}
+// 分片使用单独的缓冲区: 批量任务中的大文本分片时, 调用线程的getThreadContext()正在使用
+SegmentContext& getShardContext() {
+    static thread_local SegmentContext ctx;
+    return ctx;
+}
+
+// 一次并行任务的共享状态, 由调用线程和线程池任务共同持有
+// 调用线程只等待全部下标处理完成, 不等待线程池任务开始:
+// 线程池被占满(例如批量任务中的分片)时, 调用线程自己完成全部下标, 排队的任务开始后直接退出
+struct ParallelState {
+    ParallelState(size_t n,
+            const std::function<void(SegmentContext&, size_t)>& task,
+            SegmentContext& (*get_context)())
+        : cursor(0), n(n), task(task), get_context(get_context) {
+    }
+    void work() {
+        size_t count = 0;
+        for (size_t k = cursor++; k < n; k = cursor++) {
+            task(get_context(), k);
+            count++;
+        }
+        if (count == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        done += count;
+        if (done == n) {
+            done_cond.notify_all();
+        }
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cond.wait(lock, [this]() {
+            return done == n;
+        });
+    }
+
+    std::atomic<size_t> cursor;
+    const size_t n;
+    // 只在取到下标后访问, 调用线程返回后不再使用
+    const std::function<void(SegmentContext&, size_t)>& task;
+    SegmentContext& (*get_context)();
+    std::mutex mutex;
+    std::condition_variable done_cond;
+    size_t done = 0;
+};
+
+}
 
 TextAnalyzer::~TextAnalyzer() {
 }
 
 bool TextAnalyzer::addDict(const std::string& country, const std::string& dict_path) {
-    std::unique_ptr<DictTrie> dict_trie = std::make_unique<DictTrie>();
-    if (!dict_trie->init(dict_path)) {
+    std::unique_ptr<DictTrie> dict_trie = DictManager::load(dict_path, DICT_TEXT);
+    if (!dict_trie) {
         return false;
     }
-    g_dict_tries.insert(std::make_pair(country, std::move(dict_trie)));
+    g_dict_manager.add(country, std::move(dict_trie));
     return true;
 }
 
+bool TextAnalyzer::addDictImage(const std::string& country, const std::string& image_path) {
+    std::unique_ptr<DictTrie> dict_trie = DictManager::load(image_path, DICT_IMAGE);
+    if (!dict_trie) {
+        return false;
+    }
+    g_dict_manager.add(country, std::move(dict_trie));
+    return true;
+}
+
+void TextAnalyzer::registerDict(const std::string& country,
+        const std::string& dict_path,
+        DictFormat format) {
+    g_dict_manager.registerDict(country, dict_path, format);
+}
+
+bool TextAnalyzer::reloadDict(const std::string& country,
+        const std::string& dict_path,
+        DictFormat format) {
+    return g_dict_manager.reload(country, dict_path, format);
+}
+
+bool TextAnalyzer::addUserDict(const std::string& country,
+        const std::string& tenant,
+        const std::string& user_dict_path) {
+    return g_dict_manager.addUserDict(userDictName(country, tenant), country, user_dict_path);
+}
+
+void TextAnalyzer::setDictMemoryBudget(size_t bytes) {
+    g_dict_manager.setMemoryBudget(bytes);
+}
+
 bool TextAnalyzer::addStopWordsDict(const std::string& stop_words_path) {
     stop_trie_ = std::make_unique<DictTrie>(); 
     if (!stop_trie_->initStopWords(stop_words_path)) {
@@ -38,6 +161,58 @@ bool TextAnalyzer::addStopWordsDict(const std::string& stop_words_path) {
     return true;
 }
 
+bool TextAnalyzer::addDicts(const std::map<std::string, std::string>& dicts,
+        const std::string& stop_words_path,
+        size_t thread_num) {
+    std::vector<std::pair<std::string, std::unique_ptr<DictTrie> > > dict_tries;
+    for (const auto& dict : dicts) {
+        dict_tries.push_back(std::make_pair(dict.first, std::unique_ptr<DictTrie>()));
+    }
+    std::unique_ptr<DictTrie> stop_trie;
+    bool stop_ok = true;
+    {
+        size_t task_num = dicts.size() + (stop_words_path.empty() ? 0 : 1);
+        if (thread_num == 0) {
+            thread_num = std::thread::hardware_concurrency();
+        }
+        // 同时构建的词典数不超过线程数, 控制加载时的内存峰值
+        ThreadPool pool(std::max<size_t>(std::min(thread_num, task_num), 1));
+        size_t i = 0;
+        for (const auto& dict : dicts) {
+            std::unique_ptr<DictTrie>* dict_trie = &dict_tries[i++].second;
+            const std::string* dict_path = &dict.second;
+            pool.submit([dict_trie, dict_path]() {
+                *dict_trie = DictManager::load(*dict_path, DICT_TEXT);
+            });
+        }
+        if (!stop_words_path.empty()) {
+            pool.submit([&stop_trie, &stop_words_path, &stop_ok]() {
+                stop_trie = std::make_unique<DictTrie>();
+                stop_ok = stop_trie->initStopWords(stop_words_path);
+            });
+        }
+        pool.wait();
+    }
+    // 与逐个addDict一致: 加载成功的词典照常发布, 失败的逐个报告
+    bool ok = true;
+    auto dict = dicts.begin();
+    for (size_t i = 0; i < dict_tries.size(); i++, ++dict) {
+        if (!dict_tries[i].second) {
+            logMessage("[TextAnalyzer] failed to load dict " + dict->first + ": " + dict->second);
+            ok = false;
+        }
+    }
+    g_dict_manager.add(dict_tries);
+    if (stop_trie) {
+        if (!stop_ok) {
+            logMessage("[TextAnalyzer] failed to load stop words: " + stop_words_path);
+            ok = false;
+        }
+        stop_trie_ = std::move(stop_trie);
+    }
+    return ok;
+}
+
 // 暂时不区分地区stop_words
 void TextAnalyzer::init() {
     // Normalizer
@@ -46,13 +221,76 @@ void TextAnalyzer::init() {
     mm_seg_ = std::make_unique<MMSegment>(normalizer_.get());
     // 基于动态规划的再分词
     mp_seg_ = std::make_unique<MPSegment>(normalizer_.get());
+    applyShardSize();
+}
+
+void TextAnalyzer::setBatchThreadNum(size_t thread_num) {
+    batch_thread_num_ = thread_num;
+    // 分片上限由线程数决定
+    applyShardSize();
+}
+
+void TextAnalyzer::setShardSize(size_t shard_runes) {
+    shard_runes_ = shard_runes;
+    applyShardSize();
+}
+
+void TextAnalyzer::applyShardSize() {
+    if (!mm_seg_ || !mp_seg_) {
+        return;
+    }
+    size_t thread_num = batch_thread_num_ == 0 ? std::thread::hardware_concurrency() : batch_thread_num_;
+    // 每个线程多个分片, 分片之间的耗时差异可以均衡
+    size_t max_shards = std::max<size_t>(thread_num, 1) * SHARDS_PER_THREAD;
+    ShardExecutor executor;
+    if (shard_runes_ != 0) {
+        executor = [this](size_t n, const std::function<void(SegmentContext&, size_t)>& task) {
+            runParallel(n, task, getShardContext);
+        };
+    }
+    mm_seg_->setShardExecutor(executor, shard_runes_, max_shards);
+    mp_seg_->setShardExecutor(executor, shard_runes_, max_shards);
+}
+
+ThreadPool* TextAnalyzer::getBatchPool() const {
+    std::call_once(batch_pool_once_, [this]() {
+        size_t thread_num = batch_thread_num_;
+        if (thread_num == 0) {
+            thread_num = std::thread::hardware_concurrency();
+        }
+        // 调用线程也参与计算
+        if (thread_num > 1) {
+            batch_pool_ = std::make_unique<ThreadPool>(thread_num - 1);
+        }
+    });
+    return batch_pool_.get();
 }
 
 bool TextAnalyzer::needCut(const std::string& country) const {
-    if (g_dict_tries.find(country) != g_dict_tries.end()) {
-        return true;
+    return g_dict_manager.contains(country);
+}
+
+CountryHandle TextAnalyzer::resolveCountry(const std::string& country) const {
+    return g_dict_manager.resolve(country);
+}
+
+std::shared_ptr<const DictTrie> TextAnalyzer::getDict(const std::string& country) const {
+    return g_dict_manager.get(country);
+}
+
+bool TextAnalyzer::getDictStats(const std::string& country, DictStats& stats) const {
+    std::shared_ptr<const DictTrie> dict_trie = g_dict_manager.get(country);
+    if (!dict_trie) {
+        return false;
     }
-    return false;
+    dict_trie->getStats(stats);
+    return true;
+}
+
+std::unique_ptr<StreamSegmenter> TextAnalyzer::newStream(const std::string& country,
+        StreamMode mode) const {
+    return std::make_unique<StreamSegmenter>(normalizer_.get(), mm_seg_.get(), mp_seg_.get(),
+            resolveCountry(country), mode);
 }
 
 // 对外提供归一化功能(小写, 去除emoji以及标点)
@@ -60,6 +298,22 @@ bool TextAnalyzer::normalize(const std::string& sentence, std::vector<std::strin
     return normalizer_->normalize(sentence, res);
 }
 
+bool TextAnalyzer::normalize(const std::string& sentence, std::vector<TokenSpan>& spans) const {
+    return normalizer_->normalize(sentence, spans);
+}
+
+bool TextAnalyzer::normalize(const std::string& sentence,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
+    return normalizer_->normalize(sentence, ctx, res);
+}
+
+bool TextAnalyzer::normalize(const std::string& sentence,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    return normalizer_->normalize(sentence, ctx, spans);
+}
+
 // 默认空格切分的字符串
 std::string TextAnalyzer::normalize(const std::string& sentence) const {
     return normalizer_->normalize(sentence);
@@ -69,10 +323,340 @@ void TextAnalyzer::cut(const std::string& sentence, const std::string& country,
     mm_seg_->cut(sentence, country, res);
 }
 
+void TextAnalyzer::cut(const std::string& sentence, const std::string& country, std::vector<TokenSpan>& spans) const  {
+    mm_seg_->cut(sentence, country, spans);
+}
+
+void TextAnalyzer::cut(const std::string& sentence,
+        const std::string& country,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
+    mm_seg_->cut(sentence, country, ctx, res);
+}
+
+void TextAnalyzer::cut(const std::string& sentence,
+        const std::string& country,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    mm_seg_->cut(sentence, country, ctx, spans);
+}
+
+void TextAnalyzer::cut(const std::string& sentence,
+        const CountryHandle& handle,
+        std::vector<std::string>& res) const {
+    SegmentContext ctx;
+    mm_seg_->cut(sentence, handle, ctx, res);
+}
+
+void TextAnalyzer::cut(const std::string& sentence,
+        const CountryHandle& handle,
+        std::vector<TokenSpan>& spans) const {
+    SegmentContext ctx;
+    mm_seg_->cut(sentence, handle, ctx, spans);
+}
+
+void TextAnalyzer::cut(const std::string& sentence,
+        const CountryHandle& handle,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
+    mm_seg_->cut(sentence, handle, ctx, res);
+}
+
+void TextAnalyzer::cut(const std::string& sentence,
+        const CountryHandle& handle,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    mm_seg_->cut(sentence, handle, ctx, spans);
+}
+
 void TextAnalyzer::cutMP(const std::string& sentence, const std::string& country, std::vector<std::string>& res) const {
     mp_seg_->cut(sentence, country, res);
 }
 
+void TextAnalyzer::cutMP(const std::string& sentence, const std::string& country, std::vector<TokenSpan>& spans) const {
+    mp_seg_->cut(sentence, country, spans);
+}
+
+void TextAnalyzer::cutMP(const std::string& sentence,
+        const std::string& country,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
+    mp_seg_->cut(sentence, country, ctx, res);
+}
+
+void TextAnalyzer::cutMP(const std::string& sentence,
+        const std::string& country,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    mp_seg_->cut(sentence, country, ctx, spans);
+}
+
+void TextAnalyzer::cutMP(const std::string& sentence,
+        const CountryHandle& handle,
+        std::vector<std::string>& res) const {
+    SegmentContext ctx;
+    mp_seg_->cut(sentence, handle, ctx, res);
+}
+
+void TextAnalyzer::cutMP(const std::string& sentence,
+        const CountryHandle& handle,
+        std::vector<TokenSpan>& spans) const {
+    SegmentContext ctx;
+    mp_seg_->cut(sentence, handle, ctx, spans);
+}
+
+void TextAnalyzer::cutMP(const std::string& sentence,
+        const CountryHandle& handle,
+        SegmentContext& ctx,
+        std::vector<std::string>& res) const {
+    mp_seg_->cut(sentence, handle, ctx, res);
+}
+
+void TextAnalyzer::cutMP(const std::string& sentence,
+        const CountryHandle& handle,
+        SegmentContext& ctx,
+        std::vector<TokenSpan>& spans) const {
+    mp_seg_->cut(sentence, handle, ctx, spans);
+}
+
+bool TextAnalyzer::analyze(const std::string& sentence,
+        const std::string& country,
+        int flags,
+        AnalyzeResult& result) const {
+    // 只归一化时不需要加载词典
+    CountryHandle handle;
+    if (flags & (ANALYZE_MM | ANALYZE_MP)) {
+        handle = resolveCountry(country);
+    }
+    SegmentContext ctx;
+    return analyze(sentence, handle, flags, ctx, result);
+}
+
+bool TextAnalyzer::analyze(const std::string& sentence,
+        const CountryHandle& handle,
+        int flags,
+        SegmentContext& ctx,
+        AnalyzeResult& result) const {
+    ctx.lower_text.assign(sentence);
+    bool decoded = analyze(handle, flags, ctx);
+    // 分词失败时与cut一致, 整个输入作为一个词
+    bool segmented = decoded && handle.valid();
+    if (flags & ANALYZE_NORMALIZE) {
+        getStringsFromWordRanges(ctx.lower_text, ctx.norm_ranges, result.normalized);
+    } else {
+        result.normalized.clear();
+    }
+    if (!(flags & ANALYZE_MM)) {
+        result.mm.clear();
+    } else if (segmented) {
+        getStringsFromWordRanges(ctx.lower_text, ctx.word_ranges, result.mm);
+    } else {
+        result.mm.assign(1, ctx.lower_text);
+    }
+    if (!(flags & ANALYZE_MP)) {
+        result.mp.clear();
+    } else if (segmented) {
+        getStringsFromWordRanges(ctx.lower_text, ctx.mp_ranges, result.mp);
+    } else {
+        result.mp.assign(1, ctx.lower_text);
+    }
+    return decoded;
+}
+
+bool TextAnalyzer::analyze(const std::string& sentence,
+        const CountryHandle& handle,
+        int flags,
+        SegmentContext& ctx,
+        AnalyzeSpans& spans) const {
+    ctx.lower_text.assign(sentence);
+    bool decoded = analyze(handle, flags, ctx);
+    bool segmented = decoded && handle.valid();
+    if (flags & ANALYZE_NORMALIZE) {
+        getSpansFromWordRanges(ctx.norm_ranges, spans.normalized);
+    } else {
+        spans.normalized.clear();
+    }
+    if (!(flags & ANALYZE_MM)) {
+        spans.mm.clear();
+    } else if (segmented) {
+        getSpansFromWordRanges(ctx.word_ranges, spans.mm);
+    } else {
+        spans.mm.assign(1, getSpanOfString(sentence));
+    }
+    if (!(flags & ANALYZE_MP)) {
+        spans.mp.clear();
+    } else if (segmented) {
+        getSpansFromWordRanges(ctx.mp_ranges, spans.mp);
+    } else {
+        spans.mp.assign(1, getSpanOfString(sentence));
+    }
+    return decoded;
+}
+
+bool TextAnalyzer::analyze(const CountryHandle& handle, int flags, SegmentContext& ctx) const {
+    StringUtil::toLowerCase(ctx.lower_text);
+    ctx.norm_ranges.clear();
+    ctx.word_ranges.clear();
+    ctx.mp_ranges.clear();
+    if (!decodeRunesInString(ctx.lower_text, ctx.runes, ctx.decode_error)) {
+        return false;
+    }
+    if (ctx.runes.empty()) {
+        return true;
+    }
+    normalizer_->normalize(ctx);
+    if (!handle.valid()) {
+        return true;
+    }
+    const bool need_mm = flags & ANALYZE_MM;
+    const bool need_mp = flags & ANALYZE_MP;
+    const size_t range_num = ctx.norm_ranges.size();
+    if (need_mm && !need_mp) {
+        mm_seg_->cutNormalized(handle, ctx, 0, range_num);
+    } else if (need_mp && !need_mm) {
+        mp_seg_->cutNormalized(handle, ctx, 0, range_num);
+        ctx.mp_ranges.swap(ctx.word_ranges);
+    } else if (need_mm && need_mp) {
+        // 每个分块只查一次词典, MM与MP在同一个词图上计算
+        const DictTrie* dict = handle.dict();
+        for (std::vector<WordRange>::const_iterator it = ctx.norm_ranges.begin();
+                it != ctx.norm_ranges.end(); it++) {
+            // 数字不处理
+            if (it->isALLUnicodeDigit()) {
+                ctx.word_ranges.push_back(*it);
+                ctx.mp_ranges.push_back(*it);
+                continue;
+            }
+            dict->find(it->left, it->right + 1, ctx.lattice, MAX_WORD_LENGTH);
+            // id地区 非ascii MM不处理
+            if (handle.asciiOnly() && !it->isAllAscii()) {
+                ctx.word_ranges.push_back(*it);
+            } else {
+                mm_seg_->cutLattice(it->left, it->right + 1, ctx, ctx.word_ranges);
+            }
+            mp_seg_->cutLattice(dict, it->left, it->right + 1, ctx.lattice, ctx.mp_ranges);
+        }
+    }
+    return true;
+}
+
+bool TextAnalyzer::normalizeBatch(const std::vector<std::string>& sentences,
+        std::vector<std::vector<std::string> >& res) const {
+    return runBatch(BATCH_NORMALIZE, sentences, std::vector<std::string>(), res);
+}
+
+bool TextAnalyzer::cutBatch(const std::vector<std::string>& sentences,
+        const std::string& country,
+        std::vector<std::vector<std::string> >& res) const {
+    return runBatch(BATCH_MM, sentences, std::vector<std::string>(1, country), res);
+}
+
+bool TextAnalyzer::cutBatch(const std::vector<std::string>& sentences,
+        const std::vector<std::string>& countries,
+        std::vector<std::vector<std::string> >& res) const {
+    if (countries.size() != sentences.size()) {
+        return false;
+    }
+    return runBatch(BATCH_MM, sentences, countries, res);
+}
+
+bool TextAnalyzer::cutMPBatch(const std::vector<std::string>& sentences,
+        const std::string& country,
+        std::vector<std::vector<std::string> >& res) const {
+    return runBatch(BATCH_MP, sentences, std::vector<std::string>(1, country), res);
+}
+
+bool TextAnalyzer::cutMPBatch(const std::vector<std::string>& sentences,
+        const std::vector<std::string>& countries,
+        std::vector<std::vector<std::string> >& res) const {
+    if (countries.size() != sentences.size()) {
+        return false;
+    }
+    return runBatch(BATCH_MP, sentences, countries, res);
+}
+
+// 共享下标动态分配: 每个线程处理完一条再取下一条, 长短不一的任务也能均衡
+// 调用线程也参与计算, 线程池被其他任务占用时不会空等
+void TextAnalyzer::runParallel(size_t n,
+        const std::function<void(SegmentContext&, size_t)>& task,
+        SegmentContext& (*get_context)()) const {
+    if (n == 0) {
+        return;
+    }
+    std::shared_ptr<ParallelState> state = std::make_shared<ParallelState>(n, task, get_context);
+    ThreadPool* pool = getBatchPool();
+    size_t helper_num = pool == NULL ? 0 : std::min(pool->size(), n - 1);
+    for (size_t h = 0; h < helper_num; h++) {
+        pool->submit([state]() {
+            state->work();
+        });
+    }
+    state->work();
+    state->wait();
+}
+
+bool TextAnalyzer::runBatch(BatchMode mode,
+        const std::vector<std::string>& sentences,
+        const std::vector<std::string>& countries,
+        std::vector<std::vector<std::string> >& res) const {
+    res.resize(sentences.size());
+    // first[i]为与第i条相同的第一条输入
+    std::vector<size_t> first(sentences.size());
+    std::vector<size_t> unique;
+    {
+        std::unordered_set<size_t, BatchKeyHash, BatchKeyEqual> seen(sentences.size(),
+                BatchKeyHash(sentences, countries), BatchKeyEqual(sentences, countries));
+        for (size_t i = 0; i < sentences.size(); i++) {
+            std::pair<std::unordered_set<size_t, BatchKeyHash, BatchKeyEqual>::iterator, bool> ret =
+                seen.insert(i);
+            first[i] = *ret.first;
+            if (ret.second) {
+                unique.push_back(i);
+            }
+        }
+    }
+
+    // 每个地区只解析一次, handles[country_index[i]]为第i条输入的地区
+    std::vector<CountryHandle> handles;
+    std::vector<size_t> country_index(countries.size());
+    {
+        std::unordered_map<std::string, size_t> resolved;
+        for (size_t i = 0; i < countries.size(); i++) {
+            std::pair<std::unordered_map<std::string, size_t>::iterator, bool> ret =
+                resolved.insert(std::make_pair(countries[i], handles.size()));
+            if (ret.second) {
+                handles.push_back(resolveCountry(countries[i]));
+            }
+            country_index[i] = ret.first->second;
+        }
+    }
+
+    std::atomic<bool> ok(true);
+    runParallel(unique.size(), [&](SegmentContext& ctx, size_t k) {
+        size_t i = unique[k];
+        switch (mode) {
+            case BATCH_NORMALIZE:
+                if (!normalize(sentences[i], ctx, res[i])) {
+                    ok = false;
+                }
+                break;
+            case BATCH_MM:
+                cut(sentences[i], handles[country_index[countries.size() > 1 ? i : 0]], ctx, res[i]);
+                break;
+            case BATCH_MP:
+                cutMP(sentences[i], handles[country_index[countries.size() > 1 ? i : 0]], ctx, res[i]);
+                break;
+        }
+    }, getThreadContext);
+
+    for (size_t i = 0; i < sentences.size(); i++) {
+        if (first[i] != i) {
+            res[i] = res[first[i]];
+        }
+    }
+    return ok;
+}
+
 }
 
 /* vim: set ts=4 sw=4 sts=4 tw=100 */
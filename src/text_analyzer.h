@@ -13,13 +13,45 @@
 #ifndef TEXT_ANALYSIS_TEXT_ANALYZER_H
 #define TEXT_ANALYSIS_TEXT_ANALYZER_H
 
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
+#include "dict_manager.h"
+#include "logger.h"
 #include "normalizer.h"
 #include "mm_segment.h"
 #include "mp_segment.h"
+#include "stream_segmenter.h"
+#include "thread_pool.h"
 
 namespace text_analysis {
+
+// analyze需要的输出, 可以组合
+enum AnalyzeFlag {
+    ANALYZE_NORMALIZE = 1,  // 同normalize
+    ANALYZE_MM = 2,         // 同cut
+    ANALYZE_MP = 4,         // 同cutMP
+    ANALYZE_ALL = 7
+};
+
+// analyze的结果, 未请求的输出为空
+struct AnalyzeResult {
+    std::vector<std::string> normalized;
+    std::vector<std::string> mm;
+    std::vector<std::string> mp;
+};
+
+// token span 版本
+struct AnalyzeSpans {
+    std::vector<TokenSpan> normalized;
+    std::vector<TokenSpan> mm;
+    std::vector<TokenSpan> mp;
+};
+
 class TextAnalyzer {
 
 public:
@@ -28,26 +60,162 @@ public:
 
     // 初始化
     bool addDict(const std::string& country, const std::string& dict_path);
+    // 加载dict_compiler预编译的二进制词典(mmap)
+    bool addDictImage(const std::string& country, const std::string& image_path);
+    // 按需加载: 只记录路径, 第一次cut/cutMP该地区时加载
+    void registerDict(const std::string& country, const std::string& dict_path,
+            DictFormat format = DICT_TEXT);
+    // 热更新词典, 可以与cut/cutMP并发调用, 正在进行的分词继续使用旧词典
+    // 加载失败时返回false, 旧词典不受影响
+    bool reloadDict(const std::string& country, const std::string& dict_path,
+            DictFormat format = DICT_TEXT);
+    // 用户词典, 叠加在country词典之上, 多个tenant共享同一份country词典
+    // 分词时country参数传 userDictName(country, tenant), 即 "country@tenant"
+    bool addUserDict(const std::string& country, const std::string& tenant,
+            const std::string& user_dict_path);
+    // 按需加载词典的内存上限(字节), 超出时淘汰最久未使用的地区, 0表示不限制
+    void setDictMemoryBudget(size_t bytes);
     bool addStopWordsDict(const std::string& stop_words_path); 
+    // 多线程并行加载多个地区词典以及停用词词典(可为空), 加载完成后一次性发布
+    // 与逐个调用addDict/addStopWordsDict一致: 失败的词典交给日志回调(logger.h)并返回false, 其余照常发布
+    // thread_num 为0时使用硬件线程数(不超过词典数)
+    bool addDicts(const std::map<std::string, std::string>& dicts,
+            const std::string& stop_words_path = "",
+            size_t thread_num = 0);
     void init();
     void destroy() {
     }
+    // 批量接口使用的线程数(含调用线程), 0为硬件线程数, 1为只在调用线程中计算
+    // 线程池在第一次批量调用时创建, 需要在此之前设置
+    void setBatchThreadNum(size_t thread_num);
+    // 大文本分片并行: 归一化后不少于 2 * shard_runes 个字符的输入, 按分块边界切成约shard_runes大小的分片,
+    // 在批量接口的线程池中并发分词, 结果(含偏移)与顺序分词一致; 0为关闭(默认)
+    // 对cut/cutMP全部接口生效, 需要在并发调用之前设置
+    void setShardSize(size_t shard_runes);
 
     bool needCut(const std::string& country) const;
+    // 解析地区(词典快照与地区选项), 传给cut/cutMP的CountryHandle版本, 分词时不再按地区名查找
+    // 词典不存在或加载失败时handle无效, 此时分词结果为整个输入; 热更新后需要重新获取
+    CountryHandle resolveCountry(const std::string& country) const;
+    // 地区词典的快照, 持有期间不会被淘汰或替换; 批量查词时先取一次, 再调用DictTrie::findWord
+    std::shared_ptr<const DictTrie> getDict(const std::string& country) const;
+    // 地区词典的内存与结构统计, 词典不存在或加载失败时返回false(按需加载的词典会触发加载)
+    bool getDictStats(const std::string& country, DictStats& stats) const;
     // 清洗数据
     std::string normalize(const std::string& text) const;
     bool normalize(const std::string& text, std::vector<std::string>& res) const;
+    // token span 版本: 只返回每个词在text中的字节/unicode位置, 不复制字符串
+    // spans由调用方持有, 不按词分配内存; 结果与字符串版本一一对应(字符串版本为小写)
+    bool normalize(const std::string& text, std::vector<TokenSpan>& spans) const;
+    // 复用ctx中的缓冲区, 每个线程一个ctx, 预热后分词过程不再分配内存
+    bool normalize(const std::string& text, SegmentContext& ctx, std::vector<std::string>& res) const;
+    bool normalize(const std::string& text, SegmentContext& ctx, std::vector<TokenSpan>& spans) const;
 
     // 默认的分词方法
     // (1) 归一化
     // (2) mm分词
     void cut(const std::string& sentence, const std::string& country, std::vector<std::string>& res) const;
+    void cut(const std::string& sentence, const std::string& country, std::vector<TokenSpan>& spans) const;
+    void cut(const std::string& sentence,
+            const std::string& country,
+            SegmentContext& ctx,
+            std::vector<std::string>& res) const;
+    void cut(const std::string& sentence,
+            const std::string& country,
+            SegmentContext& ctx,
+            std::vector<TokenSpan>& spans) const;
+    void cut(const std::string& sentence, const CountryHandle& handle, std::vector<std::string>& res) const;
+    void cut(const std::string& sentence, const CountryHandle& handle, std::vector<TokenSpan>& spans) const;
+    void cut(const std::string& sentence,
+            const CountryHandle& handle,
+            SegmentContext& ctx,
+            std::vector<std::string>& res) const;
+    void cut(const std::string& sentence,
+            const CountryHandle& handle,
+            SegmentContext& ctx,
+            std::vector<TokenSpan>& spans) const;
     // 动态规划分词
     void cutMP(const std::string& sentence, const std::string& country, std::vector<std::string>& res) const;
+    void cutMP(const std::string& sentence, const std::string& country, std::vector<TokenSpan>& spans) const;
+    void cutMP(const std::string& sentence,
+            const std::string& country,
+            SegmentContext& ctx,
+            std::vector<std::string>& res) const;
+    void cutMP(const std::string& sentence,
+            const std::string& country,
+            SegmentContext& ctx,
+            std::vector<TokenSpan>& spans) const;
+    void cutMP(const std::string& sentence, const CountryHandle& handle, std::vector<std::string>& res) const;
+    void cutMP(const std::string& sentence, const CountryHandle& handle, std::vector<TokenSpan>& spans) const;
+    void cutMP(const std::string& sentence,
+            const CountryHandle& handle,
+            SegmentContext& ctx,
+            std::vector<std::string>& res) const;
+    void cutMP(const std::string& sentence,
+            const CountryHandle& handle,
+            SegmentContext& ctx,
+            std::vector<TokenSpan>& spans) const;
+
+    // 一次得到多种输出: 小写、解码、归一化只做一次, 同时需要MM与MP时两者共用同一个词图
+    // flags为AnalyzeFlag的组合, 每项结果与单独调用normalize/cut/cutMP一致(不做分片并行)
+    // 返回值同normalize, 解码失败时返回false
+    bool analyze(const std::string& sentence, const std::string& country, int flags,
+            AnalyzeResult& result) const;
+    bool analyze(const std::string& sentence,
+            const CountryHandle& handle,
+            int flags,
+            SegmentContext& ctx,
+            AnalyzeResult& result) const;
+    bool analyze(const std::string& sentence,
+            const CountryHandle& handle,
+            int flags,
+            SegmentContext& ctx,
+            AnalyzeSpans& spans) const;
+
+    // 批量接口, 结果按输入顺序写入res, res[i]与单条接口的结果一致
+    // 输入分给内部线程池, 每个线程复用自己的SegmentContext; 同一批中相同的输入(同一地区)只计算一次
+    // countries为每条输入的地区, 与sentences长度不一致时返回false
+    bool normalizeBatch(const std::vector<std::string>& sentences,
+            std::vector<std::vector<std::string> >& res) const;
+    bool cutBatch(const std::vector<std::string>& sentences,
+            const std::string& country,
+            std::vector<std::vector<std::string> >& res) const;
+    bool cutBatch(const std::vector<std::string>& sentences,
+            const std::vector<std::string>& countries,
+            std::vector<std::vector<std::string> >& res) const;
+    bool cutMPBatch(const std::vector<std::string>& sentences,
+            const std::string& country,
+            std::vector<std::vector<std::string> >& res) const;
+    bool cutMPBatch(const std::vector<std::string>& sentences,
+            const std::vector<std::string>& countries,
+            std::vector<std::vector<std::string> >& res) const;
+    // 流式分词: 每个输入流创建一个, 分块输入, 增量输出带全局偏移的词, 只保留未确定的尾部
+    // 结果与对整个输入调用一次normalize/cut/cutMP一致(见StreamSegmenter), 需要在init之后调用
+    std::unique_ptr<StreamSegmenter> newStream(const std::string& country, StreamMode mode) const;
     // MM分词
     // void cutMM(const std::string& sentence, const std::string& country, std::vector<std::string>& res) const;
     // void cutRMM(const std::string& sentence, const std::string& country, std::vector<std::string>& res) const;
     // void cutBMM(const std::string& sentence, const std::string& country, std::vector<std::string>& res) const;
+private:
+    enum BatchMode {
+        BATCH_NORMALIZE,
+        BATCH_MM,
+        BATCH_MP
+    };
+    // countries为空时不区分地区, 只有一个元素时全部输入共用
+    bool runBatch(BatchMode mode,
+            const std::vector<std::string>& sentences,
+            const std::vector<std::string>& countries,
+            std::vector<std::vector<std::string> >& res) const;
+    // 并发执行 task(ctx, k), k in [0, n), ctx为执行线程的get_context()
+    void runParallel(size_t n,
+            const std::function<void(SegmentContext&, size_t)>& task,
+            SegmentContext& (*get_context)()) const;
+    // ctx.lower_text小写后 => ctx.norm_ranges, ctx.word_ranges(MM), ctx.mp_ranges(MP)
+    // 解码失败时返回false; handle无效时只归一化
+    bool analyze(const CountryHandle& handle, int flags, SegmentContext& ctx) const;
+    ThreadPool* getBatchPool() const;
+    void applyShardSize();
 private:
     // 停用词词典
     std::unique_ptr<DictTrie> stop_trie_;
@@ -56,6 +224,12 @@ private:
     // 分词器
     std::unique_ptr<MPSegment> mp_seg_;
     std::unique_ptr<MMSegment> mm_seg_;
+    // 批量接口的线程池, 按需创建
+    static const size_t SHARDS_PER_THREAD = 4;
+    size_t batch_thread_num_ = 0;
+    size_t shard_runes_ = 0;
+    mutable std::once_flag batch_pool_once_;
+    mutable std::unique_ptr<ThreadPool> batch_pool_;
 };
 
 }
@@ -0,0 +1,83 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  thread_pool.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/10 16:05:40
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include "thread_pool.h"
+
+namespace text_analysis {
+
+ThreadPool::ThreadPool(size_t thread_num) {
+    if (thread_num == 0) {
+        thread_num = std::thread::hardware_concurrency();
+    }
+    if (thread_num == 0) {
+        thread_num = 1;
+    }
+    for (size_t i = 0; i < thread_num; i++) {
+        threads_.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    task_cond_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    task_cond_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [this]() {
+        return tasks_.empty() && running_ == 0;
+    });
+}
+
+void ThreadPool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            task_cond_.wait(lock, [this]() {
+                return stop_ || !tasks_.empty();
+            });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            running_++;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_--;
+            if (tasks_.empty() && running_ == 0) {
+                done_cond_.notify_all();
+            }
+        }
+    }
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
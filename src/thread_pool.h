@@ -0,0 +1,56 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  thread_pool.h 
+ *    Description:  简单的固定大小线程池 
+ * 
+ *        Created:  2022/03/10 16:05:33
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_THREAD_POOL_H
+#define TEXT_ANALYSIS_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace text_analysis {
+
+class ThreadPool {
+public:
+    // thread_num 为0时使用硬件线程数
+    explicit ThreadPool(size_t thread_num = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // 阻塞直到已提交的任务全部完成
+    void wait();
+
+    size_t size() const {
+        return threads_.size();
+    }
+private:
+    void run();
+private:
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable task_cond_;
+    std::condition_variable done_cond_;
+    size_t running_ = 0;
+    bool stop_ = false;
+};
+
+}
+
+#endif  // TEXT_ANALYSIS_THREAD_POOL_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -10,139 +10,436 @@
  * 
  * =====================================================================================
  */
+#include <algorithm>
+
 #include "trie.h"
 
 namespace text_analysis {
 
-Trie::Trie(const std::vector<Unicode>& keys,
-        const std::vector<const DictUnit*>& value_pointers) {
-    root_ = new TrieNode();
-    createTrie(keys, value_pointers);
-}
+namespace {
 
-Trie::~Trie() {
-    deleteNode(root_);
-}
+const Rune MAX_RUNE = Trie::MAX_RUNE;
+const uint32_t CODE_PAGE_BITS = Trie::CODE_PAGE_BITS;
+const uint32_t CODE_PAGE_MASK = Trie::CODE_PAGE_MASK;
 
-const DictUnit* Trie::find(RuneStringArray::const_iterator begin,
-        RuneStringArray::const_iterator end) const {
-    if (begin == end) {
-        return NULL;
+// 构建期使用的可变数组, 构建完成后交给Trie
+class DoubleArrayBuilder {
+public:
+    DoubleArrayBuilder(const PodArray<Rune>& runes, const PodArray<DictUnit>& units)
+        : runes_(runes), units_(units) {
     }
 
-    const TrieNode* p_node = root_;
-    TrieNode::NextMap::const_iterator citer;
-    for (RuneStringArray::const_iterator it = begin; it != end; it++) {
-        if (NULL == p_node->next) {
-            return NULL;
+    void build();
+
+public:
+    std::vector<uint32_t> code_index;
+    std::vector<uint32_t> code_pages;
+    std::vector<int32_t> base;
+    std::vector<int32_t> check;
+    std::vector<int32_t> values;
+
+private:
+    uint32_t getCode(Rune rune) const {
+        if (rune >= MAX_RUNE) {
+            return 0;
         }
-        citer = p_node->next->find(it->rune);
-        if (p_node->next->end() == citer) {
-            return NULL;
+        return code_pages[(code_index[rune >> CODE_PAGE_BITS] << CODE_PAGE_BITS)
+            | (rune & CODE_PAGE_MASK)];
+    }
+    size_t keyCount() const {
+        return units_.size();
+    }
+    size_t keySize(size_t i) const {
+        return units_[i].length;
+    }
+    // 编码后的第i个key
+    const uint32_t* keyCodes(size_t i) const {
+        return key_codes_.data() + units_[i].offset;
+    }
+    void createCodes();
+    void insertNodes(int32_t state, size_t depth, size_t left, size_t right);
+    int32_t findBase(const std::vector<uint32_t>& codes);
+    void resize(size_t size);
+    void useCell(int32_t cell);
+
+private:
+    const PodArray<Rune>& runes_;
+    const PodArray<DictUnit>& units_;
+    // runes_ 对应的编码
+    std::vector<uint32_t> key_codes_;
+    uint32_t max_code_ = 0;
+    // 按编码后字典序排列的key下标
+    std::vector<uint32_t> order_;
+    // 空闲cell的双向链表
+    std::vector<int32_t> free_next_;
+    std::vector<int32_t> free_prev_;
+    int32_t free_head_ = -1;
+    int32_t free_tail_ = -1;
+};
+
+void DoubleArrayBuilder::build() {
+    // 空trie也需要root, 保证find可用
+    code_index.assign((MAX_RUNE >> CODE_PAGE_BITS), 0);
+    code_pages.assign(CODE_PAGE_MASK + 1, 0);
+    resize(CODE_PAGE_MASK + 1);
+    useCell(0);
+    base[0] = 0;
+    check[0] = -2;
+    if (keyCount() > 0) {
+        createCodes();
+        key_codes_.resize(runes_.size());
+        for (size_t i = 0; i < runes_.size(); i++) {
+            key_codes_[i] = getCode(runes_[i]);
+        }
+
+        // 按编码后的字典序排列, stable保证重复key时后加入的覆盖先加入的
+        order_.resize(keyCount());
+        for (size_t i = 0; i < order_.size(); i++) {
+            order_[i] = i;
         }
-        p_node = citer->second;
+        std::stable_sort(order_.begin(), order_.end(), [&](uint32_t lhs, uint32_t rhs) {
+            const uint32_t* l = keyCodes(lhs);
+            const uint32_t* r = keyCodes(rhs);
+            size_t l_size = keySize(lhs);
+            size_t r_size = keySize(rhs);
+            size_t len = std::min(l_size, r_size);
+            for (size_t k = 0; k < len; k++) {
+                if (l[k] != r[k]) {
+                    return l[k] < r[k];
+                }
+            }
+            return l_size < r_size;
+        });
+        insertNodes(0, 0, 0, order_.size());
+        std::vector<uint32_t>().swap(key_codes_);
     }
-    return p_node->p_value;
-}
 
-// 遍历所有Rune(字), 从root开始查询
-// 记录所有可能的路径(词表中的词)
-// 不存在该前缀则将NULL记入map
-// 返回所有dag
-void Trie::find(RuneStringArray::const_iterator begin, 
-        RuneStringArray::const_iterator end, 
-        std::vector<struct Dag>&res, 
-        size_t max_word_len = MAX_WORD_LENGTH) const {
-    // assert(root_ != NULL);
-    // 这里把所有可能的dag全部记录下来
-    res.resize(end - begin);
+    // 截掉尾部空闲cell, 保留max_code_大小的padding, 转移时不需要再判断越界
+    int32_t max_base = 0;
+    size_t last = 0;
+    for (size_t i = 0; i < check.size(); i++) {
+        if (check[i] != -1) {
+            last = i;
+            max_base = std::max(max_base, base[i]);
+        }
+    }
+    size_t size = std::max(last + 1, size_t(max_base) + max_code_ + 1);
+    base.resize(size, 0);
+    check.resize(size, -1);
+    values.resize(size, -1);
+}
 
-    const TrieNode *p_node = NULL;
-    TrieNode::NextMap::const_iterator citer;
-    for (size_t i = 0; i < size_t(end - begin); i++) {
-        res[i].runestr = *(begin + i);
-        // 根节点查询
-        if (root_->next != NULL && root_->next->end() != (citer = root_->next->find(res[i].runestr.rune))) {
-            p_node = citer->second;
-        } else {
-            p_node = NULL;
+// 高频rune分配较小的编码, 使得兄弟节点更紧凑
+void DoubleArrayBuilder::createCodes() {
+    std::vector<std::pair<size_t, Rune> > freqs;
+    std::vector<uint32_t> rune_index(MAX_RUNE >> CODE_PAGE_BITS, 0);
+    // 第0页保留为空页
+    std::vector<std::vector<size_t> > counts(1);
+    for (size_t i = 0; i < runes_.size(); i++) {
+        Rune rune = runes_[i];
+        if (rune >= MAX_RUNE) {
+            continue;
         }
-        // 第一级Rune(字)
-        // 字本身可能也是一个词, 不存在该前缀则置为空
-        if (p_node != NULL) {
-            res[i].nexts.push_back(std::pair<size_t, const DictUnit*>(i, p_node->p_value));
-        } else {
-            res[i].nexts.push_back(std::pair<size_t, const DictUnit*>(i, static_cast<const DictUnit*>(NULL)));
+        uint32_t& page = rune_index[rune >> CODE_PAGE_BITS];
+        if (page == 0) {
+            page = counts.size();
+            counts.push_back(std::vector<size_t>(CODE_PAGE_MASK + 1, 0));
         }
-        // 开始查找词, 按照长度陆续添加
-        // example: 0 [0, 1, 4, 7]
-        for (size_t j = i + 1; j < size_t(end - begin) && (j - i + 1) <= max_word_len; j++) {
-            if (p_node == NULL || p_node->next == NULL) {
-                break;
+        counts[page][rune & CODE_PAGE_MASK]++;
+    }
+    for (size_t hi = 0; hi < rune_index.size(); hi++) {
+        if (rune_index[hi] == 0) {
+            continue;
+        }
+        const std::vector<size_t>& page = counts[rune_index[hi]];
+        for (size_t lo = 0; lo <= CODE_PAGE_MASK; lo++) {
+            if (page[lo] > 0) {
+                freqs.push_back(std::make_pair(page[lo], Rune((hi << CODE_PAGE_BITS) | lo)));
             }
-            citer = p_node->next->find((begin + j)->rune);
-            if (p_node->next->end() == citer) {
+        }
+    }
+    std::sort(freqs.begin(), freqs.end(),
+            [](const std::pair<size_t, Rune>& lhs, const std::pair<size_t, Rune>& rhs) {
+        return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+    });
+
+    code_index.swap(rune_index);
+    code_pages.assign(counts.size() * (CODE_PAGE_MASK + 1), 0);
+    for (size_t i = 0; i < freqs.size(); i++) {
+        Rune rune = freqs[i].second;
+        code_pages[(code_index[rune >> CODE_PAGE_BITS] << CODE_PAGE_BITS)
+            | (rune & CODE_PAGE_MASK)] = i + 1;
+    }
+    max_code_ = freqs.size();
+}
+
+// [left, right) 区间内的key在depth之前有相同的前缀, 对应节点state
+void DoubleArrayBuilder::insertNodes(int32_t state, size_t depth, size_t left, size_t right) {
+    size_t i = left;
+    // 最后一个节点记录word信息, 空key不记录
+    while (i < right && keySize(order_[i]) == depth) {
+        if (depth > 0) {
+            values[state] = order_[i];
+        }
+        i++;
+    }
+    if (i == right) {
+        return;
+    }
+
+    std::vector<uint32_t> codes;
+    std::vector<size_t> bounds;
+    for (size_t k = i; k < right; k++) {
+        uint32_t code = keyCodes(order_[k])[depth];
+        if (codes.empty() || codes.back() != code) {
+            codes.push_back(code);
+            bounds.push_back(k);
+        }
+    }
+    bounds.push_back(right);
+
+    int32_t b = findBase(codes);
+    base[state] = b;
+    for (size_t k = 0; k < codes.size(); k++) {
+        useCell(b + codes[k]);
+        check[b + codes[k]] = state;
+    }
+    // 兄弟节点全部占位后再向下构建
+    for (size_t k = 0; k < codes.size(); k++) {
+        insertNodes(b + codes[k], depth + 1, bounds[k], bounds[k + 1]);
+    }
+}
+
+// 从空闲链表中查找一个base, 使得所有子节点位置均空闲
+int32_t DoubleArrayBuilder::findBase(const std::vector<uint32_t>& codes) {
+    // assert(!codes.empty());
+    const uint32_t first = codes.front();
+    const uint32_t last = codes.back();
+    for (int32_t cell = free_head_; cell >= 0; cell = free_next_[cell]) {
+        int32_t b = cell - int32_t(first);
+        if (b < 1) {
+            continue;
+        }
+        if (size_t(b) + last >= check.size()) {
+            resize(std::max(check.size() * 2, size_t(b) + last + 1));
+        }
+        bool ok = true;
+        for (size_t k = 1; k < codes.size(); k++) {
+            if (check[b + codes[k]] != -1) {
+                ok = false;
                 break;
             }
-            p_node = citer->second;
-            if (NULL != p_node->p_value) {
-                res[i].nexts.push_back(std::pair<size_t, const DictUnit*>(j, p_node->p_value));
-            }
+        }
+        if (ok) {
+            return b;
         }
     }
+    // 没有可用位置, 直接扩容
+    int32_t b = std::max(int32_t(check.size()) - int32_t(first), 1);
+    resize(std::max(check.size() * 2, size_t(b) + last + 1));
+    return b;
 }
 
-void Trie::insertNode(const Unicode& key, const DictUnit* p_value) {
-    if (key.begin() == key.end()) {
+void DoubleArrayBuilder::resize(size_t size) {
+    size_t old_size = check.size();
+    if (size <= old_size) {
         return;
     }
+    base.resize(size, 0);
+    check.resize(size, -1);
+    values.resize(size, -1);
+    free_next_.resize(size, -1);
+    free_prev_.resize(size, -1);
+    // 新cell依次接在空闲链表尾部
+    for (size_t i = old_size; i < size; i++) {
+        free_prev_[i] = free_tail_;
+        free_next_[i] = -1;
+        if (free_tail_ >= 0) {
+            free_next_[free_tail_] = i;
+        } else {
+            free_head_ = i;
+        }
+        free_tail_ = i;
+    }
+}
+
+void DoubleArrayBuilder::useCell(int32_t cell) {
+    int32_t prev = free_prev_[cell];
+    int32_t next = free_next_[cell];
+    if (prev >= 0) {
+        free_next_[prev] = next;
+    } else {
+        free_head_ = next;
+    }
+    if (next >= 0) {
+        free_prev_[next] = prev;
+    } else {
+        free_tail_ = prev;
+    }
+    free_prev_[cell] = free_next_[cell] = -1;
+    check[cell] = -2;
+}
+
+}
+
+Trie::Trie(const PodArray<Rune>& runes, const PodArray<DictUnit>& units) {
+    units_ = units.data();
+    createTrie(runes, units);
+}
+
+Trie::~Trie() {
+}
 
-    TrieNode::NextMap::const_iterator km_iter;
-    TrieNode *p_node = root_;
-    for (Unicode::const_iterator citer = key.begin(); citer != key.end(); ++citer) {
-        if (NULL == p_node->next) {
-            p_node->next = new TrieNode::NextMap;
+bool Trie::load(const DictImage& image, const PodArray<DictUnit>& units) {
+    if (!image.getSection(SECTION_CODE_INDEX, code_index_)
+            || !image.getSection(SECTION_CODE_PAGES, code_pages_)
+            || !image.getSection(SECTION_BASE, base_)
+            || !image.getSection(SECTION_CHECK, check_)
+            || !image.getSection(SECTION_VALUES, values_)) {
+        return false;
+    }
+    if (code_index_.size() != (MAX_RUNE >> CODE_PAGE_BITS) || base_.empty()
+            || base_.size() != check_.size() || base_.size() != values_.size()) {
+        return false;
+    }
+    if (code_pages_.empty() || code_pages_.size() % (CODE_PAGE_MASK + 1) != 0) {
+        return false;
+    }
+    const size_t page_count = code_pages_.size() >> CODE_PAGE_BITS;
+    for (size_t i = 0; i < code_index_.size(); i++) {
+        if (code_index_[i] >= page_count) {
+            return false;
+        }
+    }
+    uint32_t max_code = 0;
+    for (size_t i = 0; i < code_pages_.size(); i++) {
+        max_code = std::max(max_code, code_pages_[i]);
+    }
+    // 与构建时的padding一致: 任意cell上的任意编码转移都不越界
+    const size_t size = base_.size();
+    for (size_t i = 0; i < size; i++) {
+        if (base_[i] < 0 || size_t(base_[i]) + max_code >= size
+                || check_[i] < -2 || check_[i] >= int32_t(size)
+                || values_[i] < -1 || values_[i] >= int64_t(units.size())) {
+            return false;
         }
-        km_iter = p_node->next->find(*citer);
-        if (p_node->next->end() == km_iter) {
-            TrieNode *nextNode = new TrieNode;
+    }
+    units_ = units.data();
+    return true;
+}
 
-            p_node->next->insert(std::make_pair(*citer, nextNode));
-            p_node = nextNode;
-        } else {
-            p_node = km_iter->second;
+void Trie::save(DictImageWriter& writer) const {
+    writer.addSection(SECTION_CODE_INDEX, code_index_);
+    writer.addSection(SECTION_CODE_PAGES, code_pages_);
+    writer.addSection(SECTION_BASE, base_);
+    writer.addSection(SECTION_CHECK, check_);
+    writer.addSection(SECTION_VALUES, values_);
+}
+
+// 已使用的cell即节点, 子节点通过check_指回父节点
+void Trie::getNodeStats(NodeStats& stats) const {
+    std::vector<uint32_t> children(check_.size(), 0);
+    stats.node_count = 0;
+    for (size_t i = 0; i < check_.size(); i++) {
+        if (check_[i] >= 0) {
+            children[check_[i]]++;
+        }
+        if (check_[i] != -1) {
+            stats.node_count++;
+        }
+    }
+    stats.bytes = memoryUsage();
+    stats.branching.assign(NodeStats::MAX_BRANCHING + 1, 0);
+    for (size_t i = 0; i < check_.size(); i++) {
+        if (check_[i] != -1) {
+            stats.branching[std::min(size_t(children[i]), NodeStats::MAX_BRANCHING)]++;
         }
     }
-    // assert(p_node != NULL);
-    // 最后一个节点记录word信息
-    p_node->p_value = p_value;
 }
 
-void Trie::createTrie(const std::vector<Unicode>& keys,
-        const std::vector<const DictUnit*>& value_pointers) {
-    if (value_pointers.empty() || keys.empty()) {
-        return;
+const DictUnit* Trie::find(RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end) const {
+    if (begin == end) {
+        return NULL;
     }
-    // assert(keys.size() == value_pointers.size());
-    for (size_t i = 0; i < keys.size(); i++) {
-        insertNode(keys[i], value_pointers[i]);
+
+    int32_t state = 0;
+    for (RuneStringArray::const_iterator it = begin; it != end; it++) {
+        state = next(state, it->rune);
+        if (state < 0) {
+            return NULL;
+        }
     }
+    return getValue(state);
 }
 
-void Trie::deleteNode(TrieNode* node) {
-    if (NULL == node) {
-        return;
+// 遍历所有Rune(字), 从root开始查询
+// 记录所有可能的路径(词表中的词)
+// 不存在该前缀则将NULL记入lattice
+void Trie::find(RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        Lattice& lattice,
+        size_t max_word_len = MAX_WORD_LENGTH) const {
+    // 这里把所有可能的词全部记录下来
+    // example: 0 [0, 1, 4, 7]
+    lattice.reset();
+    for (size_t i = 0; i < size_t(end - begin); i++) {
+        RuneStringArray::const_iterator word_end = begin + std::min(size_t(end - begin), i + max_word_len);
+        findPrefixes(begin + i, word_end, [&lattice, i](size_t k, const DictUnit* unit) {
+            lattice.addEdge(i + k, unit);
+        });
+        lattice.closePosition();
     }
-    if (NULL != node->next) {
-        for (TrieNode::NextMap::iterator it = node->next->begin();
-                it != node->next->end(); ++it) {
-            deleteNode(it->second);
+}
+
+void Trie::merge(RuneStringArray::const_iterator begin,
+        RuneStringArray::const_iterator end,
+        Lattice& lattice,
+        size_t max_word_len) const {
+    // assert(lattice.size() == size_t(end - begin));
+    // 合并结果写入merge_edges, offsets原地更新
+    std::vector<LatticeEdge>& edges = lattice.edges;
+    std::vector<LatticeEdge>& merged = lattice.merge_edges;
+    merged.clear();
+    size_t k = 0;
+    for (size_t i = 0; i < size_t(end - begin); i++) {
+        // 边按结束位置升序
+        const size_t k_end = lattice.offsets[i + 1];
+        int32_t state = 0;
+        for (size_t j = i; j < size_t(end - begin) && (j - i + 1) <= max_word_len; j++) {
+            state = next(state, (begin + j)->rune);
+            if (state < 0) {
+                break;
+            }
+            if (values_[state] < 0) {
+                continue;
+            }
+            while (k < k_end && edges[k].end < j) {
+                merged.push_back(edges[k++]);
+            }
+            // 同一位置的词以本trie为准
+            if (k < k_end && edges[k].end == j) {
+                k++;
+            }
+            LatticeEdge edge = {getValue(state), uint32_t(j)};
+            merged.push_back(edge);
         }
-        delete node->next;
-        node->next = NULL;
+        while (k < k_end) {
+            merged.push_back(edges[k++]);
+        }
+        lattice.offsets[i + 1] = merged.size();
     }
-    delete node;
-    node = NULL;
+    edges.swap(merged);
+}
+
+void Trie::createTrie(const PodArray<Rune>& runes, const PodArray<DictUnit>& units) {
+    DoubleArrayBuilder builder(runes, units);
+    builder.build();
+    code_index_.assign(builder.code_index);
+    code_pages_.assign(builder.code_pages);
+    base_.assign(builder.base);
+    check_.assign(builder.check);
+    values_.assign(builder.values);
 }
 
 }
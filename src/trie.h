@@ -16,64 +16,184 @@
 #include <unordered_map>
 
 #include "unicode.h"
+#include "pod_array.h"
+#include "dict_image.h"
 
 namespace text_analysis {
 
 const size_t MAX_WORD_LENGTH = 50;
 
+// 定长POD, 可以直接写入词典镜像
+// 词的rune统一存放在所属词典的rune数组中, 权重存放在所属词典的权重数组中(下标相同)
 struct DictUnit {
-    Unicode word;
-    double weight;
+    // 词在rune数组中的起始位置
+    // DAWG布局不保存rune, offset无效(为0), 词只能通过DictTrie::getWordRunes还原
+    uint32_t offset;
+    // 词长(rune数)
+    uint32_t length;
     // std::string tag;  // postag
 }; // struct DictUnit
 
-struct Dag {
-    RuneString runestr;
-    // 前缀词典
-    std::vector<std::pair<size_t, const DictUnit*> > nexts;
-    // 后缀词典 (暂不需要)
-    // std::vector<std::pair<size_t, const DictUnit*> > lasts;
-    // 记录route的指针
-    const DictUnit* p_info;
-    double weight;
-    size_t next_pos;
-    Dag():runestr(), p_info(NULL), weight(0.0), next_pos(0) {
-    }
-}; // struct Dag
+// 查询结构的节点统计
+struct NodeStats {
+    // 分叉数直方图的桶数, 最后一个桶为 >= MAX_BRANCHING
+    static const size_t MAX_BRANCHING = 16;
 
-class TrieNode {
-public:
-    TrieNode(): next(NULL), p_value(NULL) {
+    size_t node_count = 0;
+    // 查询结构占用的字节数(不含DictUnit)
+    size_t bytes = 0;
+    // branching[k]: 有k个子节点的节点数
+    std::vector<size_t> branching;
+}; // struct NodeStats
+
+// 词图的一条边: 从所在位置开始, 到end(含)结束的词
+struct LatticeEdge {
+    // 未登录字为NULL(只会是每个位置的第一条边)
+    const DictUnit* unit;
+    uint32_t end;
+}; // struct LatticeEdge
+
+// 扁平的词图(CSR): 全部边连续存放, 第i个位置的边为 edges[offsets[i], offsets[i+1]), 按end升序
+// 每个位置的第一条边总是单字(不是词时unit为NULL)
+// 缓冲区只增不减, 同一个Lattice反复使用时不再分配内存
+struct Lattice {
+    std::vector<uint32_t> offsets;
+    std::vector<LatticeEdge> edges;
+    // 合并用户词典时的临时边, 与edges交换
+    std::vector<LatticeEdge> merge_edges;
+    // 路径计算的结果: 第i个位置选中的边的end, 以及从i到结尾的最大权重
+    // MP分词不生成边, 只使用这几个数组
+    std::vector<uint32_t> routes;
+    std::vector<double> weights;
+    std::vector<int64_t> fixed_weights;
+    // MP分词计算过路径的分块数, 以及其中使用整数DP(定点权重词典)的分块数, 只增不减
+    size_t dp_chunks = 0;
+    size_t fixed_dp_chunks = 0;
+
+    size_t size() const {
+        return offsets.empty() ? 0 : offsets.size() - 1;
     }
-public:
-    // 后续考虑优化, 这样内存占用较高
-    typedef std::unordered_map<uint32_t, TrieNode*> NextMap;
-    NextMap *next;
-    const DictUnit* p_value;
-};
+    const LatticeEdge* edgeBegin(size_t i) const {
+        return edges.data() + offsets[i];
+    }
+    const LatticeEdge* edgeEnd(size_t i) const {
+        return edges.data() + offsets[i + 1];
+    }
+    void reset() {
+        offsets.assign(1, 0);
+        edges.clear();
+    }
+    void addEdge(size_t end, const DictUnit* unit) {
+        LatticeEdge edge = {unit, uint32_t(end)};
+        edges.push_back(edge);
+    }
+    // 当前位置的边添加完毕
+    void closePosition() {
+        offsets.push_back(edges.size());
+    }
+}; // struct Lattice
 
+// 静态双数组trie (double-array trie)
+// 构建后不可修改, 每次状态转移只需要两次数组访问:
+//   t = base_[s] + code(rune), 当 check_[t] == s 时转移成功
+// rune先通过两级表映射为紧凑编码(按出现频次从1开始编号), 0表示字典中不存在该rune
+// 全部数据都是POD数组, 可以直接写入/映射词典镜像
 class Trie {
 public:
-    Trie(const std::vector<Unicode>& keys, const std::vector<const DictUnit*>& valuePointers);
+    Trie() {
+    }
+    // 第i个key为 units[i] 在runes中对应的词
+    Trie(const PodArray<Rune>& runes, const PodArray<DictUnit>& units);
     ~Trie();
 
-    // 返回全部可能的dag
+    // 从镜像中加载, 数组直接指向映射内存
+    // 校验全部下标都在数组范围内(查询时不再判断越界), 损坏的镜像返回false
+    bool load(const DictImage& image, const PodArray<DictUnit>& units);
+    void save(DictImageWriter& writer) const;
+
+    // 数组占用的字节数
+    size_t memoryUsage() const {
+        return code_index_.bytes() + code_pages_.bytes()
+            + base_.bytes() + check_.bytes() + values_.bytes();
+    }
+
+    // 以begin开头的全部词, 按词尾升序回调 visit(k, unit), k为词尾相对begin的位置
+    // 首字总是回调(不是词时unit为NULL), 不分配内存
+    template <class Visit>
+    void findPrefixes(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            Visit visit) const {
+        if (begin == end) {
+            return;
+        }
+        int32_t state = next(0, begin->rune);
+        visit(0, state >= 0 ? getValue(state) : NULL);
+        for (size_t k = 1; state >= 0 && k < size_t(end - begin); k++) {
+            state = next(state, (begin + k)->rune);
+            if (state >= 0 && values_[state] >= 0) {
+                visit(k, getValue(state));
+            }
+        }
+    }
+
+    // 返回全部可能的词, 位置相对begin
     void find(RuneStringArray::const_iterator begin,
             RuneStringArray::const_iterator end,
-            std::vector<struct Dag>& res,
+            Lattice& lattice,
+            size_t max_word_len) const;
+
+    // 在lattice(其他trie的find结果)上合并本trie的词, 同一位置的词覆盖原有的
+    // 每个位置只多一次本trie的前缀遍历
+    void merge(RuneStringArray::const_iterator begin,
+            RuneStringArray::const_iterator end,
+            Lattice& lattice,
             size_t max_word_len) const;
 
     // 基本的find
     const DictUnit* find(RuneStringArray::const_iterator begin,
-            RuneStringArray::const_iterator end) const; 
+            RuneStringArray::const_iterator end) const;
+
+    // 遍历全部cell, 不适合在分词路径上调用
+    void getNodeStats(NodeStats& stats) const;
 private:
     // 对外不暴露构造与删除
-    void createTrie(const std::vector<Unicode>& keys, const std::vector<const DictUnit*>& value_pointers);
-    void insertNode(const Unicode& key, const DictUnit* p_value);
-    void deleteNode(TrieNode* node);
+    void createTrie(const PodArray<Rune>& runes, const PodArray<DictUnit>& units);
+
+    uint32_t getCode(Rune rune) const {
+        if (rune >= MAX_RUNE) {
+            return 0;
+        }
+        return code_pages_[(code_index_[rune >> CODE_PAGE_BITS] << CODE_PAGE_BITS)
+            | (rune & CODE_PAGE_MASK)];
+    }
+    // 状态转移, 失败返回-1
+    int32_t next(int32_t state, Rune rune) const {
+        uint32_t code = getCode(rune);
+        if (code == 0) {
+            return -1;
+        }
+        int32_t t = base_[state] + code;
+        return check_[t] == state ? t : -1;
+    }
+    const DictUnit* getValue(int32_t state) const {
+        return values_[state] < 0 ? NULL : units_ + values_[state];
+    }
+
+public:
+    static const Rune MAX_RUNE = 0x110000;
+    static const uint32_t CODE_PAGE_BITS = 8;
+    static const uint32_t CODE_PAGE_MASK = (1 << CODE_PAGE_BITS) - 1;
 
 private:
-    TrieNode* root_ = NULL;
+    // rune => code 两级映射, 第0页全部为0
+    PodArray<uint32_t> code_index_;
+    PodArray<uint32_t> code_pages_;
+
+    PodArray<int32_t> base_;
+    PodArray<int32_t> check_;
+    // 节点对应的DictUnit下标, -1表示非词尾
+    PodArray<int32_t> values_;
+    const DictUnit* units_ = NULL;
 };
 
 }
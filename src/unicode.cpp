@@ -13,33 +13,36 @@
 
 #include <iostream>
 #include "unicode.h"
+#include "utf8_decoder.h"
 
 namespace text_analysis {
 
 bool decodeRunesInString(const char* s, size_t len, RuneStringArray& runes) {
-    runes.clear();
-    runes.reserve(len);
-    for (uint32_t i = 0, j = 0; i < len;) {
-        RuneString rp = decodeRuneFromUtf8(s + i, len - i);
-        if (rp.len == 0) {
-            runes.clear();
-            return false;
-        }
-        // 赋值真实offset/length
-        rp.offset = i;
-        rp.unicode_offset = j;
-        rp.unicode_length = 1;
-        runes.push_back(rp);
-        i += rp.len;
-        ++j;
+    size_t error_offset = 0;
+    if (len > MAX_DECODE_BYTES) {
+        runes.clear();
+        return false;
     }
-    return true;
+    return decodeUtf8(s, len, runes, error_offset);
 }
 
 bool decodeRunesInString(const std::string& s, RuneStringArray& runes) {
     return decodeRunesInString(s.c_str(), s.size(), runes);
 }
 
+bool decodeRunesInString(const std::string& s, RuneStringArray& runes, size_t& error_offset) {
+    if (s.size() > MAX_DECODE_BYTES) {
+        runes.clear();
+        error_offset = MAX_DECODE_BYTES;
+        return false;
+    }
+    if (decodeUtf8(s.c_str(), s.size(), runes, error_offset)) {
+        error_offset = std::string::npos;
+        return true;
+    }
+    return false;
+}
+
 bool decodeRunesInString(const char* s, size_t len, Unicode& unicode) {
     unicode.clear();
     RuneStringArray runes;
@@ -97,6 +100,40 @@ std::vector<Word> getWordsFromWordRanges(const std::string& s, const std::vector
     return result;
 }
 
+void getStringsFromWordRanges(const std::string& s,
+        const std::vector<WordRange>& word_ranges,
+        std::vector<std::string>& strs) {
+    // 复用strs中已有字符串的内存
+    strs.resize(word_ranges.size());
+    for (size_t i = 0; i < word_ranges.size(); i++) {
+        const WordRange& wr = word_ranges[i];
+        strs[i].assign(s, wr.left->offset, wr.right->offset - wr.left->offset + wr.right->len);
+    }
+}
+
+void getSpansFromWordRanges(const std::vector<WordRange>& word_ranges,
+        std::vector<TokenSpan>& spans) {
+    spans.clear();
+    spans.reserve(word_ranges.size());
+    for (const auto& wr : word_ranges) {
+        spans.push_back(TokenSpan(wr.left->offset,
+                    wr.right->offset - wr.left->offset + wr.right->len,
+                    wr.left->unicode_offset,
+                    wr.right->unicode_offset - wr.left->unicode_offset + wr.right->unicode_length));
+    }
+}
+
+// 非 10xxxxxx 的字节即一个rune的开始
+TokenSpan getSpanOfString(const std::string& s) {
+    uint64_t unicode_length = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        if ((uint8_t(s[i]) & 0xc0) != 0x80) {
+            unicode_length++;
+        }
+    }
+    return TokenSpan(0, s.size(), 0, unicode_length);
+}
+
 void getStringsFromWords(const std::vector<Word>& words, std::vector<std::string>& strs) {
     strs.clear();
     strs.resize(words.size());
@@ -44,6 +44,26 @@ inline std::ostream& operator << (std::ostream& os, const Word& w) {
     return os << "{\"word\": \"" << w.word << "\", \"offset\": " << w.offset << "}";
 }
 
+// 分词结果在输入中的位置, 不复制字符串
+// 小写转换不改变字节长度, 位置对原始输入与小写后的数据都有效
+// 与StreamToken一样用64位: 无法解码时整个输入作为一个span, 超过4GiB也不会截断
+struct TokenSpan {
+    uint64_t offset;  // 字节位置
+    uint64_t length;  // 字节长度
+    uint64_t unicode_offset;
+    uint64_t unicode_length;
+
+    TokenSpan(): offset(0), length(0), unicode_offset(0), unicode_length(0) {
+    }
+    TokenSpan(uint64_t o, uint64_t l, uint64_t unicode_offset, uint64_t unicode_length)
+        : offset(o), length(l), unicode_offset(unicode_offset), unicode_length(unicode_length) {
+    }
+}; // struct TokenSpan
+
+inline std::ostream& operator << (std::ostream& os, const TokenSpan& span) {
+    return os << "{\"offset\": " << span.offset << ", \"length\": " << span.length << "}";
+}
+
 // string中一个unicode字符的基本信息
 struct RuneString {
     Rune rune;
@@ -172,6 +192,25 @@ inline RuneString decodeRuneFromUtf8(const char* str, size_t len) {
     return rp;
 }
 
+// rune编码为utf8追加到str, 与decodeRuneFromUtf8对应
+inline void encodeRuneToUtf8(Rune rune, std::string& str) {
+    if (rune < 0x80) {
+        str.push_back(char(rune));
+    } else if (rune < 0x800) {
+        str.push_back(char(0xc0 | (rune >> 6)));
+        str.push_back(char(0x80 | (rune & 0x3f)));
+    } else if (rune < 0x10000) {
+        str.push_back(char(0xe0 | (rune >> 12)));
+        str.push_back(char(0x80 | ((rune >> 6) & 0x3f)));
+        str.push_back(char(0x80 | (rune & 0x3f)));
+    } else {
+        str.push_back(char(0xf0 | ((rune >> 18) & 0x07)));
+        str.push_back(char(0x80 | ((rune >> 12) & 0x3f)));
+        str.push_back(char(0x80 | ((rune >> 6) & 0x3f)));
+        str.push_back(char(0x80 | (rune & 0x3f)));
+    }
+}
+
 inline bool isSingleWord(const std::string& str) {
     RuneString rp = decodeRuneFromUtf8(str.c_str(), str.size());
     return rp.len == str.size();
@@ -186,9 +225,14 @@ inline bool isUnicodeDigit(const Rune rune) {
     return false;
 }
 
+// RuneString的位置为32位, 更长的输入不解码(按失败处理), 分词时整个输入作为一个词
+const size_t MAX_DECODE_BYTES = 0xffffffffu;
+
 // trans string => unicode
 bool decodeRunesInString(const char* s, size_t len, std::vector<RuneString>& runes);
 bool decodeRunesInString(const std::string& s, RuneStringArray& runes);
+// 非法utf8时error_offset为第一个非法序列的字节位置, 超过MAX_DECODE_BYTES时为MAX_DECODE_BYTES, 成功时为npos
+bool decodeRunesInString(const std::string& s, RuneStringArray& runes, size_t& error_offset);
 bool decodeRunesInString(const char* s, size_t len, Unicode& unicode);
 bool decodeRunesInString(const std::string& s, Unicode& unicode);
 Unicode decodeRunesInString(const std::string& s);
@@ -199,6 +243,15 @@ void getWordsFromWordRanges(const std::string& s,
         const std::vector<WordRange>& word_ranges,
         std::vector<Word>& words);
 void getStringsFromWords(const std::vector<Word>& words, std::vector<std::string>& strs);
+// 直接从word_ranges取字符串, 每个词只复制一次, strs中已有的字符串复用内存
+void getStringsFromWordRanges(const std::string& s,
+        const std::vector<WordRange>& word_ranges,
+        std::vector<std::string>& strs);
+// spans会先清空, 保留容量, 重复使用时不分配内存
+void getSpansFromWordRanges(const std::vector<WordRange>& word_ranges,
+        std::vector<TokenSpan>& spans);
+// 整个字符串作为一个span(不分词时的结果)
+TokenSpan getSpanOfString(const std::string& s);
 
 }
 
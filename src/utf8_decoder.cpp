@@ -0,0 +1,441 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  utf8_decoder.cpp 
+ *    Description:  
+ * 
+ *        Created:  2022/03/30 11:02:51
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <string.h>
+
+#include "ascii_scanner.h"
+#include "utf8_decoder.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEXT_ANALYSIS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace text_analysis {
+
+namespace {
+
+inline bool isContinuation(uint8_t c) {
+    return (c & 0xc0) == 0x80;
+}
+
+// p开始的合法序列的字节数, 非法或者不完整时返回0
+inline size_t validLength(const uint8_t* p, size_t len) {
+    uint8_t c = p[0];
+    if (c < 0x80) {
+        return 1;
+    }
+    // 单独的后续字节, 或者2字节的超长编码(c0/c1)
+    if (c < 0xc2) {
+        return 0;
+    }
+    if (c < 0xe0) {
+        return len >= 2 && isContinuation(p[1]) ? 2 : 0;
+    }
+    // 第二个字节的范围排除超长编码、代理区以及超出U+10FFFF
+    uint8_t lo = 0x80;
+    uint8_t hi = 0xbf;
+    if (c < 0xf0) {
+        if (c == 0xe0) {
+            lo = 0xa0;
+        } else if (c == 0xed) {
+            hi = 0x9f;
+        }
+        return len >= 3 && p[1] >= lo && p[1] <= hi && isContinuation(p[2]) ? 3 : 0;
+    }
+    if (c < 0xf5) {
+        if (c == 0xf0) {
+            lo = 0x90;
+        } else if (c == 0xf4) {
+            hi = 0x8f;
+        }
+        return len >= 4 && p[1] >= lo && p[1] <= hi
+            && isContinuation(p[2]) && isContinuation(p[3]) ? 4 : 0;
+    }
+    return 0;
+}
+
+// 按首字节得到的序列长度, 只用于已校验的首字节
+inline size_t leadLength(uint8_t c) {
+    return c < 0x80 ? 1 : (c < 0xe0 ? 2 : (c < 0xf0 ? 3 : 4));
+}
+
+// 已校验的n字节序列
+inline Rune decodeValid(const uint8_t* p, size_t n) {
+    switch (n) {
+        case 1:
+            return p[0];
+        case 2:
+            return ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+        case 3:
+            return ((p[0] & 0x0f) << 12) | ((p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+        default:
+            return ((p[0] & 0x07) << 18) | ((p[1] & 0x3f) << 12) | ((p[2] & 0x3f) << 6)
+                | (p[3] & 0x3f);
+    }
+}
+
+inline bool isAscii8(const uint8_t* p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return (word & 0x8080808080808080ULL) == 0;
+}
+
+// 直接写入预先分配的runes, unicode_offset即已写入的个数
+struct RuneWriter {
+    RuneString* begin;
+    RuneString* out;
+
+    void ascii(const uint8_t* p, size_t pos, size_t n) {
+        uint32_t unicode_offset = out - begin;
+        for (size_t k = 0; k < n; k++) {
+            out[k] = RuneString(p[pos + k], pos + k, 1, unicode_offset + k, 1);
+        }
+        out += n;
+    }
+    void rune(Rune r, size_t pos, size_t n) {
+        *out = RuneString(r, pos, n, out - begin, 1);
+        out++;
+    }
+};
+
+// 只校验, 不输出
+struct NullWriter {
+    void ascii(const uint8_t*, size_t, size_t) {
+    }
+};
+
+size_t findInvalidScalar(const uint8_t* p, size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+        if (pos + 8 <= len && isAscii8(p + pos)) {
+            pos += 8;
+            continue;
+        }
+        size_t n = validLength(p + pos, len - pos);
+        if (n == 0) {
+            return pos;
+        }
+        pos += n;
+    }
+    return len;
+}
+
+// 写入位置保存在局部的writer中, 避免每次写入之后重新读取
+bool decodeScalar(const uint8_t* p, size_t len, RuneWriter& writer, size_t& error_offset) {
+    RuneWriter w = writer;
+    size_t pos = 0;
+    while (pos < len) {
+        // 8字节一次判断是否全ascii
+        if (pos + 8 <= len && isAscii8(p + pos)) {
+            w.ascii(p, pos, 8);
+            pos += 8;
+            continue;
+        }
+        size_t n = validLength(p + pos, len - pos);
+        if (n == 0) {
+            error_offset = pos;
+            return false;
+        }
+        w.rune(decodeValid(p + pos, n), pos, n);
+        pos += n;
+    }
+    writer = w;
+    return true;
+}
+
+#ifdef TEXT_ANALYSIS_X86_SIMD
+
+// 块[block, block + W)校验失败: 之前的块都合法, 从块前至多3个字节中的字符起点开始标量定位
+size_t locateInvalid(const uint8_t* p, size_t len, size_t block) {
+    size_t from = block > 3 ? block - 3 : 0;
+    while (from < block && isContinuation(p[from])) {
+        from++;
+    }
+    return from + findInvalidScalar(p + from, len - from);
+}
+
+// 解码[pos, end)中开始的字符(可以跨过end), 所在的块已经校验过
+// 最后一个字符不完整时停止, 由之后补0的块报错
+inline size_t appendRunes(const uint8_t*, size_t, size_t, size_t end, NullWriter&) {
+    return end;
+}
+
+inline size_t appendRunes(const uint8_t* p, size_t len, size_t pos, size_t end, RuneWriter& w) {
+    while (pos < end) {
+        size_t n = leadLength(p[pos]);
+        if (pos + n > len) {
+            break;
+        }
+        w.rune(decodeValid(p + pos, n), pos, n);
+        pos += n;
+    }
+    return pos;
+}
+
+// Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte":
+// 前一个字节的高/低半字节与当前字节的高半字节各查一张表, 三者的交集不为0即错误
+// 第3/4个字节是否应为后续字节单独由前2/3个字节判断
+const uint8_t TOO_SHORT = 1 << 0;       // 11______ 0_______ / 11______ 11______
+const uint8_t TOO_LONG = 1 << 1;        // 0_______ 10______
+const uint8_t OVERLONG_3 = 1 << 2;      // 11100000 100_____
+const uint8_t TOO_LARGE = 1 << 3;       // 11110100 1001____ / 11110100 101_____
+const uint8_t SURROGATE = 1 << 4;       // 11101101 101_____
+const uint8_t OVERLONG_2 = 1 << 5;      // 1100000_ 10______
+const uint8_t TOO_LARGE_1000 = 1 << 6;  // 11110101+ 1000____
+const uint8_t OVERLONG_4 = 1 << 6;      // 11110000 1000____
+const uint8_t TWO_CONTS = 1 << 7;       // 10______ 10______
+const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+const uint8_t BYTE_1_HIGH[16] = {
+    // 0_______: ascii
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    // 10______: 后续字节
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    // 1100____ / 1101____ / 1110____ / 1111____: 首字节
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+const uint8_t BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,  // ____0000
+    CARRY | OVERLONG_2,                            // ____0001
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,                             // ____0100
+    CARRY | TOO_LARGE | TOO_LARGE_1000,            // ____0101 ~ ____1111
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,  // ____1101
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+const uint8_t BYTE_2_HIGH[16] = {
+    // 0_______: ascii
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    // 1000____ / 1001____ / 101_____: 后续字节
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    // 11______: 首字节
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+// 块末尾的多字节序列未完成: 倒数第3/2/1个字节不小于 0xf0/0xe0/0xc0
+const uint8_t INCOMPLETE_MAX[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf,
+};
+
+__attribute__((target("sse4.2")))
+inline __m128i blockErrorSse(__m128i input, __m128i prev_input) {
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i byte_1_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH));
+    const __m128i byte_1_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW));
+    const __m128i byte_2_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH));
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i special = _mm_and_si128(
+            _mm_and_si128(
+                _mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+            _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(char(0xe0 - 0x80))),
+            _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xf0 - 0x80))));
+    return _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8(char(0x80))), special);
+}
+
+template <class Writer>
+__attribute__((target("sse4.2")))
+bool decodeSse(const uint8_t* p, size_t len, Writer& writer, size_t& error_offset) {
+    Writer w = writer;
+    const __m128i incomplete_max = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(INCOMPLETE_MAX + 16));
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    size_t pos = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        if (_mm_movemask_epi8(input) == 0) {
+            // 全ascii: 只需要上一块末尾没有未完成的序列
+            if (!_mm_testz_si128(prev_incomplete, prev_incomplete)) {
+                error_offset = locateInvalid(p, len, i);
+                return false;
+            }
+            w.ascii(p, pos, i + 16 - pos);
+            pos = i + 16;
+            prev_incomplete = _mm_setzero_si128();
+        } else {
+            __m128i error = blockErrorSse(input, prev_input);
+            if (!_mm_testz_si128(error, error)) {
+                error_offset = locateInvalid(p, len, i);
+                return false;
+            }
+            prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+            pos = appendRunes(p, len, pos, i + 16, w);
+        }
+        prev_input = input;
+    }
+    // 不足一块的剩余字节补0(ascii), 没有剩余时检查上一块末尾的序列是否完整
+    uint8_t tail[16] = {0};
+    memcpy(tail, p + i, len - i);
+    __m128i error = blockErrorSse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tail)),
+            prev_input);
+    if (!_mm_testz_si128(error, error)) {
+        error_offset = locateInvalid(p, len, i);
+        return false;
+    }
+    appendRunes(p, len, pos, len, w);
+    writer = w;
+    return true;
+}
+
+// 跨128位lane拼接: 结果的第k个字节为 (prev_input, input) 中input[k - n]
+#define TEXT_ANALYSIS_PREV_AVX2(input, prev_input, n) \
+    _mm256_alignr_epi8((input), _mm256_permute2x128_si256((prev_input), (input), 0x21), 16 - (n))
+
+__attribute__((target("avx2")))
+inline __m256i blockErrorAvx2(__m256i input, __m256i prev_input) {
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i byte_1_high = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH)));
+    const __m256i byte_1_low = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW)));
+    const __m256i byte_2_high = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH)));
+    __m256i prev1 = TEXT_ANALYSIS_PREV_AVX2(input, prev_input, 1);
+    __m256i special = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_shuffle_epi8(byte_1_high,
+                    _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+            _mm256_shuffle_epi8(byte_2_high,
+                _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+    __m256i prev2 = TEXT_ANALYSIS_PREV_AVX2(input, prev_input, 2);
+    __m256i prev3 = TEXT_ANALYSIS_PREV_AVX2(input, prev_input, 3);
+    __m256i must23 = _mm256_or_si256(
+            _mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xe0 - 0x80))),
+            _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xf0 - 0x80))));
+    return _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8(char(0x80))), special);
+}
+
+#undef TEXT_ANALYSIS_PREV_AVX2
+
+template <class Writer>
+__attribute__((target("avx2")))
+bool decodeAvx2(const uint8_t* p, size_t len, Writer& writer, size_t& error_offset) {
+    Writer w = writer;
+    const __m256i incomplete_max = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(INCOMPLETE_MAX));
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t pos = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        if (_mm256_movemask_epi8(input) == 0) {
+            if (!_mm256_testz_si256(prev_incomplete, prev_incomplete)) {
+                error_offset = locateInvalid(p, len, i);
+                return false;
+            }
+            w.ascii(p, pos, i + 32 - pos);
+            pos = i + 32;
+            prev_incomplete = _mm256_setzero_si256();
+        } else {
+            __m256i error = blockErrorAvx2(input, prev_input);
+            if (!_mm256_testz_si256(error, error)) {
+                error_offset = locateInvalid(p, len, i);
+                return false;
+            }
+            prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+            pos = appendRunes(p, len, pos, i + 32, w);
+        }
+        prev_input = input;
+    }
+    uint8_t tail[32] = {0};
+    memcpy(tail, p + i, len - i);
+    __m256i error = blockErrorAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail)),
+            prev_input);
+    if (!_mm256_testz_si256(error, error)) {
+        error_offset = locateInvalid(p, len, i);
+        return false;
+    }
+    appendRunes(p, len, pos, len, w);
+    writer = w;
+    return true;
+}
+
+#endif
+
+}
+
+size_t findInvalidUtf8(const char* data, size_t len) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    NullWriter w;
+    size_t error_offset = len;
+    switch (simdLevel()) {
+#ifdef TEXT_ANALYSIS_X86_SIMD
+        case SIMD_AVX2:
+            decodeAvx2(p, len, w, error_offset);
+            return error_offset;
+        case SIMD_SSE42:
+            decodeSse(p, len, w, error_offset);
+            return error_offset;
+#endif
+        default:
+            return findInvalidScalar(p, len);
+    }
+}
+
+bool decodeUtf8(const char* data, size_t len, RuneStringArray& runes, size_t& error_offset) {
+    // rune数不超过字节数; 已有的元素直接覆盖, 重复使用时不再构造
+    runes.resize(len);
+    RuneWriter w;
+    w.begin = runes.data();
+    w.out = w.begin;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    bool ok = false;
+    switch (simdLevel()) {
+#ifdef TEXT_ANALYSIS_X86_SIMD
+        case SIMD_AVX2:
+            ok = decodeAvx2(p, len, w, error_offset);
+            break;
+        case SIMD_SSE42:
+            ok = decodeSse(p, len, w, error_offset);
+            break;
+#endif
+        default:
+            ok = decodeScalar(p, len, w, error_offset);
+            break;
+    }
+    if (!ok) {
+        runes.clear();
+        return false;
+    }
+    runes.resize(w.out - w.begin);
+    return true;
+}
+
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
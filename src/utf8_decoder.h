@@ -0,0 +1,38 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  utf8_decoder.h 
+ *    Description:  utf8校验与解码, 按块向量化, 非法输入定位到第一个非法序列 
+ * 
+ *        Created:  2022/03/30 11:02:45
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#ifndef TEXT_ANALYSIS_UTF8_DECODER_H
+#define TEXT_ANALYSIS_UTF8_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "unicode.h"
+
+namespace text_analysis {
+
+// 按RFC 3629校验: 不接受超长编码、代理区(U+D800~U+DFFF)、超出U+10FFFF以及不完整的序列
+// x86上按 AVX2(32字节) / SSE4.2(16字节) / 标量 运行时选择(同AsciiScanner):
+//   每块先用一次比较判断是否全ascii, 全ascii的块直接写出;
+//   其余的块用查表法(Keiser & Lemire)整块校验, 再逐字符解码; 出错时回到标量定位
+
+// 只校验, 返回第一个非法序列的起始字节位置, 全部合法时返回len
+size_t findInvalidUtf8(const char* data, size_t len);
+
+// 解码并校验, 失败时runes为空, error_offset为第一个非法序列的起始字节位置
+bool decodeUtf8(const char* data, size_t len, RuneStringArray& runes, size_t& error_offset);
+
+}
+
+#endif  // TEXT_ANALYSIS_UTF8_DECODER_H
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,266 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  dawg_test.cpp 
+ *    Description:  DAWG布局(不保存词的rune与完美哈希)与trie布局的查词、分词结果一致 
+ * 
+ *        Created:  2022/04/02 15:06:12
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "src/text_analyzer.h"
+#include "src/nlp_stringutil.h"
+
+using namespace text_analysis;
+
+namespace {
+
+std::string toUtf8(const std::vector<Rune>& runes) {
+    std::string word;
+    for (size_t i = 0; i < runes.size(); i++) {
+        encodeRuneToUtf8(runes[i], word);
+    }
+    return word;
+}
+
+// 同一个词两种布局都查不到, 或者查到的权重与词长相同
+bool sameWord(const DictTrie& trie, const DictTrie& dawg, const std::string& word) {
+    const DictUnit* t = trie.findWord(word);
+    const DictUnit* d = dawg.findWord(word);
+    if (t == NULL || d == NULL) {
+        return t == d;
+    }
+    return trie.getWeight(t) == dawg.getWeight(d) && t->length == d->length;
+}
+
+// 直接构建自动机: 空key不记录, 重复key以最后一个为准, 下标为字典序排名, 相同的后缀合并为同一状态
+bool testBuild() {
+    const char* const keys[] = {"b", "", "ab", "abc", "b", "xbc", "\xe0\xb8\x81", "\xe0\xb8\x81\xe0\xb8\xb2"};
+    const size_t key_num = sizeof(keys) / sizeof(keys[0]);
+    std::vector<Rune> rune_vec;
+    std::vector<DictUnit> unit_vec;
+    std::vector<double> weights;
+    for (size_t i = 0; i < key_num; i++) {
+        Unicode runes;
+        decodeRunesInString(keys[i], runes);
+        DictUnit unit;
+        unit.offset = rune_vec.size();
+        unit.length = runes.size();
+        rune_vec.insert(rune_vec.end(), runes.begin(), runes.end());
+        unit_vec.push_back(unit);
+        weights.push_back(double(i));
+    }
+    PodArray<Rune> runes;
+    PodArray<DictUnit> units;
+    runes.assign(rune_vec);
+    units.assign(unit_vec);
+    Dawg dawg(runes, units, weights);
+
+    bool ok = true;
+    // 排名顺序, 以及每个词在原始输入中的位置(即权重)
+    const char* const ranked[] = {"ab", "abc", "b", "xbc", "\xe0\xb8\x81", "\xe0\xb8\x81\xe0\xb8\xb2"};
+    const double ranked_weights[] = {2.0, 3.0, 4.0, 5.0, 6.0, 7.0};
+    const size_t ranked_num = sizeof(ranked) / sizeof(ranked[0]);
+    if (units.size() != ranked_num || weights.size() != ranked_num) {
+        std::cerr << "build: " << units.size() << " words, expected " << ranked_num << std::endl;
+        return false;
+    }
+    std::vector<Rune> key;
+    for (size_t rank = 0; rank < ranked_num; rank++) {
+        dawg.getKey(rank, key);
+        const std::string word(ranked[rank]);
+        if (toUtf8(key) != word || units[rank].length != key.size() || units[rank].offset != 0
+                || weights[rank] != ranked_weights[rank]
+                || dawg.findWord(word.data(), word.size()) != &units[rank]) {
+            std::cerr << "build: rank " << rank << " is " << toUtf8(key) << ", expected " << word
+                << std::endl;
+            ok = false;
+        }
+    }
+    const char* const missing[] = {"", "a", "bc", "abcd", "x", "xb", "\xe0\xb8\xb2"};
+    for (size_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++) {
+        if (dawg.findWord(missing[i], strlen(missing[i])) != NULL) {
+            std::cerr << "build: found " << missing[i] << std::endl;
+            ok = false;
+        }
+    }
+    // root, a, ab, xb, x, ก, 以及 abc/xbc/b/กา 共用的终止状态; trie需要10个
+    if (dawg.stateCount() != 7) {
+        std::cerr << "build: " << dawg.stateCount() << " states, expected 7" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// 文本词典中的重复词、共享前缀与后缀的词, 三种加载方式的查词结果一致, 非规范编码查不到
+bool testLookup(const std::string& dict_path, const DictTrie& trie, const DictTrie& dawg,
+        const std::string& name) {
+    bool ok = true;
+    std::vector<std::string> words;
+    std::ifstream infile(dict_path.c_str());
+    std::string line;
+    while (std::getline(infile, line)) {
+        const std::string word = line.substr(0, line.find('\t'));
+        words.push_back(word);
+        words.push_back(word + "a");
+        words.push_back(word.substr(0, word.size() - 1));
+    }
+    const char* const invalid[] = {"", "\xff", "\xc1\x81", "\xe0\x80\x80", "\xed\xa0\x80", "a\x80"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        words.push_back(invalid[i]);
+        if (dawg.findWord(invalid[i]) != NULL) {
+            std::cerr << name << ": invalid utf8 found" << std::endl;
+            ok = false;
+        }
+    }
+    for (size_t i = 0; i < words.size(); i++) {
+        if (!sameWord(trie, dawg, words[i])) {
+            std::cerr << name << ": lookup differs for " << words[i] << std::endl;
+            ok = false;
+        }
+    }
+    std::vector<Rune> runes;
+    const PodArray<DictUnit>& ranked = dawg.getUnits();
+    for (size_t i = 0; i < ranked.size(); i++) {
+        dawg.getWordRunes(ranked[i], runes);
+        if (runes.size() != ranked[i].length || dawg.findWord(toUtf8(runes)) != &ranked[i]) {
+            std::cerr << name << ": word " << i << " can not be restored" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool writeDict(const std::string& path) {
+    std::ofstream outfile(path.c_str());
+    // 重复的词以最后一个为准; makan/dimakan/termakan 共用后缀, makan/makanan 共用前缀
+    outfile << "makan\t5\n"
+        << "minum\t8\n"
+        << "dimakan\t3\n"
+        << "termakan\t2\n"
+        << "makanan\t6\n"
+        << "makan\t40\n"
+        << "nasi\t9\n"
+        << "nasi goreng\t4\n"
+        << "\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99\t7\n"
+        << "\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99\xe0\xb8\x82\xe0\xb9\x89\xe0\xb8\xb2\xe0\xb8\xa7\t3\n"
+        << "\xe0\xb8\x97\xe0\xb8\xb2\xe0\xb8\x99\xe0\xb8\x82\xe0\xb9\x89\xe0\xb8\xb2\xe0\xb8\xa7\t2\n"
+        << "\xe0\xb8\x82\xe0\xb9\x89\xe0\xb8\xb2\xe0\xb8\xa7\t6\n"
+        << "\xf0\x9f\x98\x80\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99\t1\n";
+    return outfile.good();
+}
+
+// 一行一句, 跳过空行与#注释
+bool readLines(const std::string& path, std::vector<std::string>& lines) {
+    std::ifstream infile(path.c_str());
+    std::string line;
+    while (std::getline(infile, line)) {
+        if (!line.empty() && line[0] != '#') {
+            lines.push_back(line);
+        }
+    }
+    return !lines.empty();
+}
+
+// trie布局为基准, DAWG(文本与镜像)的MP分词结果一致
+bool testCut(const TextAnalyzer& analyzer, const std::string& country,
+        const std::vector<std::string>& lines) {
+    SegmentContext ctx;
+    std::vector<std::string> expected;
+    std::vector<std::string> words;
+    const std::string others[] = {country + "_dawg", country + "_image"};
+    bool ok = true;
+    for (size_t k = 0; k < 2; k++) {
+        for (size_t i = 0; i < lines.size(); i++) {
+            analyzer.cutMP(lines[i], country, ctx, expected);
+            analyzer.cutMP(lines[i], others[k], ctx, words);
+            if (words != expected) {
+                std::cerr << others[k] << ": " << StringUtil::join(words, "|")
+                    << "\n  trie: " << StringUtil::join(expected, "|") << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+// 三种布局注册为三个地区, DAWG镜像只有units与自动机
+bool registerLayouts(TextAnalyzer& analyzer, const std::string& country,
+        const std::string& dict_path, const std::string& tmp_dir,
+        DictTrie& trie, DictTrie& image) {
+    DictTrie dawg;
+    const std::string image_path = tmp_dir + "/" + country + ".dawg.bin";
+    if (!trie.init(dict_path) || !dawg.init(dict_path, DICT_LAYOUT_DAWG)
+            || !dawg.saveImage(image_path) || !image.initImage(image_path)
+            || image.layout() != DICT_LAYOUT_DAWG) {
+        std::cerr << "build dawg failed: " << dict_path << std::endl;
+        return false;
+    }
+    analyzer.registerDict(country, dict_path, DICT_TEXT);
+    analyzer.registerDict(country + "_dawg", dict_path, DICT_TEXT_DAWG);
+    analyzer.registerDict(country + "_image", image_path, DICT_IMAGE);
+    return true;
+}
+
+}
+
+// usage: dawg_test <data_dir> <text_dir> <tmp_dir>
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " <data_dir> <text_dir> <tmp_dir>" << std::endl;
+        return 1;
+    }
+    const std::string data_dir = argv[1];
+    const std::string text_dir = argv[2];
+    const std::string tmp_dir = argv[3];
+    bool ok = testBuild();
+
+    TextAnalyzer analyzer;
+    analyzer.addStopWordsDict(data_dir + "/symbols.unicode.txt");
+    analyzer.init();
+
+    const std::string small_path = tmp_dir + "/small.dict.utf8";
+    DictTrie small_trie;
+    DictTrie small_image;
+    if (!writeDict(small_path)
+            || !registerLayouts(analyzer, "small", small_path, tmp_dir, small_trie, small_image)) {
+        return 1;
+    }
+    ok = testLookup(small_path, small_trie, small_image, "small") && ok;
+    std::vector<std::string> lines;
+    lines.push_back("makanan dimakan termakanmakan makann");
+    lines.push_back("nasi goreng nasigoreng minumnasi");
+    lines.push_back("\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99\xe0\xb8\x82\xe0\xb9\x89\xe0\xb8\xb2\xe0\xb8\xa7"
+            "\xe0\xb8\x97\xe0\xb8\xb2\xe0\xb8\x99\xe0\xb8\x82\xe0\xb9\x89\xe0\xb8\xb2\xe0\xb8\xa7"
+            "\xf0\x9f\x98\x80\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99");
+    ok = testCut(analyzer, "small", lines) && ok;
+
+    // 真实词典上的文本
+    const char* const dicts[][2] = {{"th", "thai.dict.utf8"}, {"id", "id.dict.utf8"}};
+    for (size_t d = 0; d < 2; d++) {
+        DictTrie trie;
+        DictTrie image;
+        lines.clear();
+        if (!registerLayouts(analyzer, dicts[d][0], data_dir + "/dict/" + dicts[d][1], tmp_dir,
+                    trie, image)
+                || !readLines(text_dir + "/" + dicts[d][0] + ".txt", lines)) {
+            return 1;
+        }
+        ok = testCut(analyzer, dicts[d][0], lines) && ok;
+    }
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "dawg_test passed" << std::endl;
+    return 0;
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
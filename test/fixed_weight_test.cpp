@@ -0,0 +1,178 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  fixed_weight_test.cpp 
+ *    Description:  定点权重与浮点权重的MP分词结果一致 
+ * 
+ *        Created:  2022/04/01 10:12:37
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "src/text_analyzer.h"
+#include "src/nlp_stringutil.h"
+
+using namespace text_analysis;
+
+namespace {
+
+const DictWeightType TYPES[] = {DICT_WEIGHT_DOUBLE, DICT_WEIGHT_FIXED16, DICT_WEIGHT_FIXED32};
+const char* const TYPE_NAMES[] = {"double", "fixed16", "fixed32"};
+const size_t TYPE_NUM = 3;
+
+// 每种权重类型各自从文本词典编译一个镜像
+bool compileImages(const std::string& dict_path, const std::string& image_prefix,
+        std::vector<std::string>& images) {
+    images.clear();
+    for (size_t t = 0; t < TYPE_NUM; t++) {
+        images.push_back(image_prefix + "." + TYPE_NAMES[t] + ".bin");
+        DictTrie dict;
+        if (!dict.init(dict_path) || !dict.quantizeWeights(TYPES[t]) || !dict.saveImage(images.back())) {
+            std::cerr << "compile " << TYPE_NAMES[t] << " image failed: " << dict_path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 一行一句, 跳过空行与#注释
+bool readLines(const std::string& path, std::vector<std::string>& lines) {
+    std::ifstream infile(path.c_str());
+    if (!infile) {
+        std::cerr << "open failed: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(infile, line)) {
+        if (!line.empty() && line[0] != '#') {
+            lines.push_back(line);
+        }
+    }
+    return true;
+}
+
+// 依次加载三种镜像, 每行的MP分词结果都要与浮点镜像完全相同
+// 定点词典的每个分块都由整数DP完成, 浮点词典一个也没有
+bool checkSameAsDouble(TextAnalyzer& analyzer, const std::string& country,
+        const std::vector<std::string>& images, const std::vector<std::string>& lines,
+        std::vector<std::vector<std::string> >& expected) {
+    SegmentContext ctx;
+    std::vector<std::string> words;
+    expected.assign(lines.size(), std::vector<std::string>());
+    bool ok = true;
+    for (size_t t = 0; t < TYPE_NUM; t++) {
+        DictStats stats;
+        if (!analyzer.reloadDict(country, images[t], DICT_IMAGE)
+                || !analyzer.getDictStats(country, stats) || stats.weight_type != TYPES[t]) {
+            std::cerr << country << ": load " << TYPE_NAMES[t] << " image failed" << std::endl;
+            return false;
+        }
+        const size_t dp_chunks = ctx.lattice.dp_chunks;
+        const size_t fixed_dp_chunks = ctx.lattice.fixed_dp_chunks;
+        size_t diff = 0;
+        for (size_t i = 0; i < lines.size(); i++) {
+            analyzer.cutMP(lines[i], country, ctx, words);
+            if (t == 0) {
+                expected[i] = words;
+            } else if (words != expected[i] && diff++ < 5) {
+                std::cerr << country << " " << TYPE_NAMES[t] << ": " << StringUtil::join(words, "|")
+                    << "\n  double: " << StringUtil::join(expected[i], "|") << std::endl;
+            }
+        }
+        const size_t chunks = ctx.lattice.dp_chunks - dp_chunks;
+        const size_t fixed_chunks = ctx.lattice.fixed_dp_chunks - fixed_dp_chunks;
+        if (chunks == 0 || fixed_chunks != (t == 0 ? 0 : chunks)) {
+            std::cerr << country << " " << TYPE_NAMES[t] << ": " << fixed_chunks << " / " << chunks
+                << " chunks used the integer DP" << std::endl;
+            ok = false;
+        }
+        if (diff > 0) {
+            std::cerr << country << " " << TYPE_NAMES[t] << ": " << diff << " / " << lines.size()
+                << " lines differ from double" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 数学上完全并列的切分: 词频 a:10, aa:1, 总词频100(zzz只用于凑总词频), weight(aa) = log(0.01) = 2 * weight(a)
+// 浮点累加的顺序不同会差几个ulp, 定点累加精确相等; 两者都保留先出现(较短)的词
+bool testExactTies(TextAnalyzer& analyzer, const std::string& tmp_dir) {
+    const std::string dict_path = tmp_dir + "/ties.dict.utf8";
+    {
+        std::ofstream outfile(dict_path.c_str());
+        outfile << "a\t10\naa\t1\nzzz\t89\n";
+    }
+    std::vector<std::string> images;
+    if (!compileImages(dict_path, tmp_dir + "/ties", images)) {
+        return false;
+    }
+    std::vector<std::string> lines;
+    std::vector<std::string> answers;
+    lines.push_back("aaaa");
+    answers.push_back("a|a|a|a");
+    // 不做并列处理时, 浮点DP在这一行会因舍入选出aa
+    lines.push_back("aaaaaaaaaaaa");
+    answers.push_back("a|a|a|a|a|a|a|a|a|a|a|a");
+    // 未登录字夹在并列之间
+    lines.push_back("aaxaaa");
+    answers.push_back("a|a|x|a|a|a");
+    lines.push_back("aa aaaaa");
+    answers.push_back("a|a|a|a|a|a|a");
+    std::vector<std::vector<std::string> > expected;
+    if (!checkSameAsDouble(analyzer, "ties", images, lines, expected)) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (StringUtil::join(expected[i], "|") != answers[i]) {
+            std::cerr << "ties: " << lines[i] << " => " << StringUtil::join(expected[i], "|")
+                << ", expected " << answers[i] << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 真实文本: 商品标题、评论, 以及拼写错误、连写、乱码等未登录字较多的行(未登录字取量化后的最小权重)
+bool testCountry(TextAnalyzer& analyzer, const std::string& data_dir,
+        const std::string& text_dir, const std::string& tmp_dir,
+        const std::string& country, const std::string& dict_name) {
+    std::vector<std::string> images;
+    std::vector<std::string> lines;
+    if (!compileImages(data_dir + "/dict/" + dict_name, tmp_dir + "/" + country, images)
+            || !readLines(text_dir + "/" + country + ".txt", lines)) {
+        return false;
+    }
+    std::vector<std::vector<std::string> > expected;
+    return checkSameAsDouble(analyzer, country, images, lines, expected);
+}
+
+}
+
+// usage: fixed_weight_test <data_dir> <text_dir> <tmp_dir>
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " <data_dir> <text_dir> <tmp_dir>" << std::endl;
+        return 1;
+    }
+    TextAnalyzer analyzer;
+    analyzer.addStopWordsDict(std::string(argv[1]) + "/symbols.unicode.txt");
+    analyzer.init();
+    bool ok = testExactTies(analyzer, argv[3]);
+    ok = testCountry(analyzer, argv[1], argv[2], argv[3], "th", "thai.dict.utf8") && ok;
+    ok = testCountry(analyzer, argv[1], argv[2], argv[3], "id", "id.dict.utf8") && ok;
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "fixed_weight_test passed" << std::endl;
+    return 0;
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,190 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  segment_context_test.cpp 
+ *    Description:  复用SegmentContext时, 预热后span版本的分词不再分配内存 
+ * 
+ *        Created:  2022/04/01 14:36:18
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "src/text_analyzer.h"
+
+using namespace text_analysis;
+
+namespace {
+
+// 只统计本线程调用operator new的次数(分词不使用线程池)
+size_t g_alloc_count = 0;
+
+void* countedAlloc(size_t size) {
+    g_alloc_count++;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+}
+
+void* operator new(size_t size) {
+    return countedAlloc(size);
+}
+void* operator new[](size_t size) {
+    return countedAlloc(size);
+}
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+struct Item {
+    std::string country;
+    std::string text;
+};
+
+const char* const API_NAMES[] = {"normalize", "cut", "cutMP", "cut(handle)", "cutMP(handle)",
+    "analyze"};
+const size_t API_NUM = 6;
+
+// 一条输入调用第k个复用ctx的span接口, 输出同样由调用方复用
+void segmentOne(const TextAnalyzer& analyzer, const Item& item, const CountryHandle& handle,
+        size_t k, SegmentContext& ctx, std::vector<TokenSpan>& spans,
+        AnalyzeSpans& analyze_spans) {
+    switch (k) {
+    case 0:
+        analyzer.normalize(item.text, ctx, spans);
+        break;
+    case 1:
+        analyzer.cut(item.text, item.country, ctx, spans);
+        break;
+    case 2:
+        analyzer.cutMP(item.text, item.country, ctx, spans);
+        break;
+    case 3:
+        analyzer.cut(item.text, handle, ctx, spans);
+        break;
+    case 4:
+        analyzer.cutMP(item.text, handle, ctx, spans);
+        break;
+    default:
+        analyzer.analyze(item.text, handle, ANALYZE_ALL, ctx, analyze_spans);
+        break;
+    }
+}
+
+// 一行一句, 跳过空行与#注释
+bool readLines(const std::string& path, const std::string& country, std::vector<Item>& items) {
+    std::ifstream infile(path.c_str());
+    if (!infile) {
+        std::cerr << "open failed: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(infile, line)) {
+        if (!line.empty() && line[0] != '#') {
+            Item item = {country, line};
+            items.push_back(item);
+        }
+    }
+    return true;
+}
+
+}
+
+// usage: segment_context_test <data_dir> <text_dir>
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <data_dir> <text_dir>" << std::endl;
+        return 1;
+    }
+    const std::string data_dir = argv[1];
+    const std::string text_dir = argv[2];
+    const char* const dicts[][2] = {{"th", "thai.dict.utf8"}, {"id", "id.dict.utf8"}};
+
+    TextAnalyzer analyzer;
+    std::vector<Item> items;
+    for (size_t d = 0; d < 2; d++) {
+        if (!analyzer.addDict(dicts[d][0], data_dir + "/dict/" + dicts[d][1])
+                || !readLines(text_dir + "/" + dicts[d][0] + ".txt", dicts[d][0], items)) {
+            std::cerr << "load failed: " << dicts[d][0] << std::endl;
+            return 1;
+        }
+    }
+    // 缓冲区大小取决于的各种情况: 空输入, 只有停用词, 没有停用词的长片段(DP分块),
+    // 多字符停用词(emoji组合), 非法utf8, 未加载的地区
+    std::string unspaced;
+    for (size_t i = 0; i < 200; i++) {
+        unspaced += "sayamakannasigoreng";
+    }
+    const std::string extra[][2] = {
+        {"id", ""},
+        {"id", " , . ! ? \xF0\x9F\x98\x80 \xF0\x9F\x91\xA8\xE2\x80\x8D\xE2\x9D\xA4\xEF\xB8\x8F"},
+        {"id", unspaced},
+        {"id", "Hello, World! saya makan nasi  123 abc \xF0\x9F\x98\x80 di rumah."},
+        {"id", "ab\xFF" "cd saya \xE4\xB8 makan \xED\xA0\x80"},
+        {"th", "\xE0\xB8\x81\xE0\xB8\xB4\xE0\xB8\x99\xF0\x9F\x91\xA8\xE2\x80\x8D\xE2\x9D\xA4\xEF\xB8\x8F"
+            "\xE0\xB8\x82\xE0\xB9\x89\xE0\xB8\xB2\xE0\xB8\xA7"},
+        {"xx", "no dict for this country"},
+    };
+    for (size_t i = 0; i < sizeof(extra) / sizeof(extra[0]); i++) {
+        Item item = {extra[i][0], extra[i][1]};
+        items.push_back(item);
+    }
+    analyzer.addStopWordsDict(data_dir + "/symbols.unicode.txt");
+    analyzer.init();
+    std::vector<CountryHandle> handles;
+    for (size_t i = 0; i < items.size(); i++) {
+        handles.push_back(analyzer.resolveCountry(items[i].country));
+    }
+
+    SegmentContext ctx;
+    std::vector<TokenSpan> spans;
+    AnalyzeSpans analyze_spans;
+    // 预热: 缓冲区增长到全部输入需要的大小
+    for (size_t i = 0; i < items.size(); i++) {
+        for (size_t k = 0; k < API_NUM; k++) {
+            segmentOne(analyzer, items[i], handles[i], k, ctx, spans, analyze_spans);
+        }
+    }
+    // 逆序再来一遍: 长输入之后的短输入, 以及不同接口交替, 每次调用都不能分配
+    bool ok = true;
+    for (size_t i = items.size(); i-- > 0; ) {
+        for (size_t k = 0; k < API_NUM; k++) {
+            g_alloc_count = 0;
+            segmentOne(analyzer, items[i], handles[i], k, ctx, spans, analyze_spans);
+            if (g_alloc_count != 0) {
+                std::cerr << API_NAMES[k] << " allocated " << g_alloc_count << " times: "
+                    << items[i].country << " " << items[i].text.substr(0, 60) << std::endl;
+                ok = false;
+            }
+        }
+    }
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "segment_context_test passed" << std::endl;
+    return 0;
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,223 @@
+/*
+ * =====================================================================================
+ * 
+ *       Filename:  stream_segmenter_test.cpp 
+ *    Description:  流式分词与整体分词结果一致, 与输入的切分方式无关 
+ * 
+ *        Created:  2022/04/02 10:21:44
+ *         Author:  philister.zhang
+ *   Organization:  
+ * 
+ * =====================================================================================
+ */
+#include <ctype.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/text_analyzer.h"
+
+using namespace text_analysis;
+
+namespace {
+
+const char* const MODE_NAMES[] = {"normalize", "mm", "mp"};
+
+// 按cuts中的位置切分输入(cuts递增), 最后调用finish
+void feedCuts(const TextAnalyzer& analyzer, const std::string& country, StreamMode mode,
+        const std::string& text, const std::vector<size_t>& cuts, std::vector<StreamToken>& all) {
+    std::unique_ptr<StreamSegmenter> stream = analyzer.newStream(country, mode);
+    std::vector<StreamToken> tokens;
+    all.clear();
+    size_t pos = 0;
+    for (size_t i = 0; i <= cuts.size(); i++) {
+        size_t end = i < cuts.size() ? cuts[i] : text.size();
+        stream->feed(text.data() + pos, end - pos, tokens);
+        all.insert(all.end(), tokens.begin(), tokens.end());
+        pos = end;
+    }
+    stream->finish(tokens);
+    all.insert(all.end(), tokens.begin(), tokens.end());
+}
+
+bool sameTokens(const std::vector<StreamToken>& a, const std::vector<StreamToken>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].word != b[i].word || a[i].offset != b[i].offset
+                || a[i].unicode_offset != b[i].unicode_offset
+                || a[i].unicode_length != b[i].unicode_length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string joinTokens(const std::vector<StreamToken>& tokens) {
+    std::string res;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        res += (i == 0 ? "" : "|") + tokens[i].word;
+    }
+    return res;
+}
+
+// 整个输入调用一次normalize/cut/cutMP的结果
+void wholeTokens(const TextAnalyzer& analyzer, const std::string& country, StreamMode mode,
+        const std::string& text, std::vector<StreamToken>& all) {
+    std::vector<TokenSpan> spans;
+    if (mode == STREAM_MM) {
+        analyzer.cut(text, country, spans);
+    } else if (mode == STREAM_MP) {
+        analyzer.cutMP(text, country, spans);
+    } else {
+        analyzer.normalize(text, spans);
+    }
+    all.clear();
+    for (const auto& span : spans) {
+        std::string word = text.substr(span.offset, span.length);
+        for (size_t i = 0; i < word.size(); i++) {
+            word[i] = tolower(word[i]);
+        }
+        all.push_back(StreamToken(word, span.offset, span.unicode_offset, span.unicode_length));
+    }
+}
+
+bool checkCuts(const TextAnalyzer& analyzer, StreamMode mode, const std::string& text,
+        const std::vector<size_t>& cuts, const std::vector<StreamToken>& expected) {
+    std::vector<StreamToken> tokens;
+    feedCuts(analyzer, "small", mode, text, cuts, tokens);
+    if (sameTokens(tokens, expected)) {
+        return true;
+    }
+    std::cerr << MODE_NAMES[mode] << " cut at";
+    for (size_t i = 0; i < cuts.size(); i++) {
+        std::cerr << " " << cuts[i];
+    }
+    std::cerr << ": " << joinTokens(tokens) << "\n  whole: " << joinTokens(expected) << std::endl;
+    return false;
+}
+
+// 每个位置断开一次、每两个位置各断开一次、逐字节输入, 都与整体结果一致
+// 断开的位置因此覆盖了每个多字节字符的内部, 以及每个多字符停用词的内部
+bool testSplits(const TextAnalyzer& analyzer, const std::string& text) {
+    bool ok = true;
+    std::vector<StreamToken> expected;
+    std::vector<size_t> cuts;
+    for (int m = 0; m < 3 && ok; m++) {
+        StreamMode mode = StreamMode(m);
+        wholeTokens(analyzer, "small", mode, text, expected);
+        for (size_t i = 1; i < text.size() && ok; i++) {
+            cuts.assign(1, i);
+            ok = checkCuts(analyzer, mode, text, cuts, expected);
+            for (size_t j = i + 1; j < text.size() && ok; j++) {
+                cuts.assign(1, i);
+                cuts.push_back(j);
+                ok = checkCuts(analyzer, mode, text, cuts, expected);
+            }
+        }
+        cuts.clear();
+        for (size_t i = 1; i < text.size(); i++) {
+            cuts.push_back(i);
+        }
+        ok = ok && checkCuts(analyzer, mode, text, cuts, expected);
+    }
+    return ok;
+}
+
+// 非法utf8单独输出, 与整体分词不可比, 只比较逐字节输入与一次输入
+bool testInvalid(const TextAnalyzer& analyzer, const std::string& text) {
+    bool ok = true;
+    std::vector<StreamToken> expected;
+    std::vector<size_t> cuts;
+    for (int m = 0; m < 3; m++) {
+        StreamMode mode = StreamMode(m);
+        feedCuts(analyzer, "small", mode, text, cuts, expected);
+        std::vector<size_t> bytes;
+        for (size_t i = 1; i < text.size(); i++) {
+            bytes.push_back(i);
+        }
+        ok = checkCuts(analyzer, mode, text, bytes, expected) && ok;
+    }
+    return ok;
+}
+
+bool writeFiles(const std::string& dict_path, const std::string& stop_words_path) {
+    std::ofstream dict(dict_path.c_str());
+    dict << "makan\t40\nmakanan\t6\nenak\t9\nharga\t7\nmurah\t8\nnasi\t9\ngoreng\t5\n"
+        << "caf\xc3\xa9\t3\n"
+        << "\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99\t7\n"  // กิน
+        << "\xe0\xb8\x82\xe0\xb9\x89\xe0\xb8\xb2\xe0\xb8\xa7\t6\n"  // ข้าว
+        << "\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99\xe0\xb8\x82\xe0\xb9\x89\xe0\xb8\xb2\xe0\xb8\xa7\t3\n"
+        << "\xe0\xb8\xad\xe0\xb8\xa3\xe0\xb9\x88\xe0\xb8\xad\xe0\xb8\xa2\t5\n"  // อร่อย
+        << "\xe4\xb8\xad\xe6\x96\x87\t2\n";  // 中文
+    std::ofstream stop_words(stop_words_path.c_str());
+    // 空格, 换行, 逗号, 句号, 省略号; 。; ไม่; 👨‍👩 与以它为前缀的 👨‍👩‍👧
+    stop_words << "32\n10\n44\n46\n46 46 46\n12290\n3652 3617 3656\n"
+        << "128104 8205 128105\n128104 8205 128105 8205 128103\n";
+    return dict.good() && stop_words.good();
+}
+
+}
+
+// usage: stream_segmenter_test <tmp_dir>
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <tmp_dir>" << std::endl;
+        return 1;
+    }
+    const std::string dict_path = std::string(argv[1]) + "/stream.dict.utf8";
+    const std::string stop_words_path = std::string(argv[1]) + "/stream.stop_words.txt";
+    TextAnalyzer analyzer;
+    if (!writeFiles(dict_path, stop_words_path) || !analyzer.addDict("small", dict_path)
+            || !analyzer.addStopWordsDict(stop_words_path)) {
+        std::cerr << "load dict failed" << std::endl;
+        return 1;
+    }
+    analyzer.init();
+
+    std::vector<std::string> texts;
+    // 多字符停用词夹在词中间, 以及只出现前缀(👨‍ 后面不是 👩)的情况
+    texts.push_back("Makanan enak,harga murah...nasi goreng"
+            "\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7" "enak"
+            "\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9" "makan"
+            "\xf0\x9f\x91\xa8\xe2\x80\x8d" "makanan..");
+    // 泰文(3字节)停用词 ไม่ 与词相连, 。结尾
+    texts.push_back("\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99\xe0\xb8\x82\xe0\xb9\x89\xe0\xb8\xb2\xe0\xb8\xa7"
+            "\xe0\xb9\x84\xe0\xb8\xa1\xe0\xb9\x88\xe0\xb8\xad\xe0\xb8\xa3\xe0\xb9\x88\xe0\xb8\xad\xe0\xb8\xa2"
+            "\xe0\xb9\x84\xe0\xb8\xa1\xe0\xb9\x88\xe0\xb9\x84\xe0\xb8\xa1\xe0\xb9\x88"
+            "\xe0\xb8\x81\xe0\xb8\xb4\xe0\xb8\x99\xe3\x80\x82");
+    // 2/3/4字节的未登录字符, 输入以停用词的前缀结束
+    texts.push_back("Caf\xc3\xa9 cr\xc3\xa8me \xe4\xb8\xad\xe6\x96\x87\xf0\x9f\x98\x80\xf0\x9f\x98\x80"
+            "makan\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d");
+    bool ok = true;
+    for (size_t i = 0; i < texts.size(); i++) {
+        ok = testSplits(analyzer, texts[i]) && ok;
+    }
+    // 非法序列: 单个非法字节, 截断的3字节字符(之后是停用词), 代理区, 输入结尾的不完整字符
+    ok = testInvalid(analyzer, "makan\xff" "enak \xe4\xb8 nasi\xed\xa0\x80" "goreng \xe4\xb8") && ok;
+
+    // 不带任何停用词的长文本逐字节输入: 每个字节只处理常数次, 否则超时
+    std::string unspaced;
+    for (size_t i = 0; i < 20000; i++) {
+        unspaced += "makanannasigorengenakmurah";
+    }
+    std::vector<StreamToken> expected;
+    std::vector<size_t> cuts;
+    for (size_t i = 1; i < unspaced.size(); i++) {
+        cuts.push_back(i);
+    }
+    for (int m = 0; m < 3; m++) {
+        wholeTokens(analyzer, "small", StreamMode(m), unspaced, expected);
+        ok = checkCuts(analyzer, StreamMode(m), unspaced, cuts, expected) && ok;
+    }
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "stream_segmenter_test passed" << std::endl;
+    return 0;
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */